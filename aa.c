@@ -0,0 +1,256 @@
+// Edge-only anti-aliasing. The kernels decide every pixel by the field at its
+// center alone, so the iso-contour comes out jagged. Supersampling the whole
+// frame would multiply the cost of the kernels, but only the pixels the
+// contour goes through need it.
+//
+// The candidates are the pixels that disagree with any of their 8 neighbours
+// about being background. For every candidate the field and its analytic
+// gradient at the center give a linear estimate of the field over the pixel,
+// and the contour can cross the pixel only if |s - FIELD_THRESHOLD| is below
+// the change of that estimate from the center to the farthest corner. Only
+// those pixels are evaluated at AA_SAMPLES x AA_SAMPLES points and get the
+// average of their colors, which blends the color of the balls with the
+// background by the covered fraction of the pixel.
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#define AA_SAMPLES 4
+// The frame is searched for the candidates in blocks of AA_BLOCK x AA_BLOCK
+// pixels. The blocks where the bounds of the field (see field_bounds()) stay
+// on one side of the threshold can't have any and are skipped right away.
+#define AA_BLOCK 16
+
+typedef struct {
+    size_t width, height;
+    // Whether any pixel of the block may be a candidate
+    uint8_t *blocks;
+    // 1 for the candidates of the last frame in the blocks that may have any.
+    // Found in a separate pass before any pixel changes, so the tiles never
+    // see the blended pixels of their neighbours.
+    uint8_t *edges;
+    // Scratch scenes with just the balls of a tile, one per thread of the pool
+    Scene *tile_scenes;
+    size_t tile_scenes_count;
+} Aa;
+
+typedef struct {
+    Aa *aa;
+    Pixel32 *pixels;
+    const Scene *scene;
+    // NULL if every tile goes through all of the balls
+    const Bins *bins;
+    atomic_size_t supersampled;
+} Aa_Job;
+
+static inline size_t aa_blocks_x(const Aa *aa)
+{
+    return (aa->width + AA_BLOCK - 1) / AA_BLOCK;
+}
+
+// The balls of the scene that can reach the tile
+static const Scene *aa_tile_scene(const Aa_Job *job, size_t index)
+{
+    if (job->bins == NULL) return job->scene;
+
+    Scene *tile_scene = &job->aa->tile_scenes[pool_thread_index()];
+    const Bins *bins = job->bins;
+    scene_copy_subset(job->scene, &bins->items[bins->offsets[index]],
+                      bins->offsets[index + 1] - bins->offsets[index], tile_scene);
+    return tile_scene;
+}
+
+static void aa_find_edges(Aa_Job *job, size_t x0, size_t y0, size_t x1, size_t y1)
+{
+    size_t width = job->aa->width, height = job->aa->height;
+
+    // Whether the columns of the 3 rows around the current one have any
+    // foreground and any background pixel, with a column of margin on both
+    // sides of the block
+    uint8_t any_fg[AA_BLOCK + 2], any_bg[AA_BLOCK + 2];
+    size_t cx0 = x0 > 0 ? x0 - 1 : x0, cx1 = x1 < width ? x1 + 1 : x1;
+    Pixel32 background = job->scene->background;
+    for (size_t y = y0; y < y1; ++y) {
+        const Pixel32 *above = &job->pixels[(y > 0 ? y - 1 : y)*width];
+        const Pixel32 *row = &job->pixels[y*width];
+        const Pixel32 *below = &job->pixels[(y + 1 < height ? y + 1 : y)*width];
+        for (size_t x = cx0; x < cx1; ++x) {
+            uint8_t a = above[x] != background, r = row[x] != background, b = below[x] != background;
+            any_fg[x - cx0] = a | r | b;
+            any_bg[x - cx0] = (a & r & b) ^ 1;
+        }
+
+        uint8_t *edges = &job->aa->edges[y*width];
+        for (size_t x = x0; x < x1; ++x) {
+            size_t l = x > cx0 ? x - 1 - cx0 : 0, c = x - cx0, r = x + 1 < cx1 ? x + 1 - cx0 : c;
+            edges[x] = (any_fg[l] | any_fg[c] | any_fg[r]) & (any_bg[l] | any_bg[c] | any_bg[r]);
+        }
+    }
+}
+
+static void aa_find_edges_tile(void *arg, size_t index)
+{
+    Aa_Job *job = arg;
+    Aa *aa = job->aa;
+    size_t x0, y0, x1, y1;
+    tile_rect(index, aa->width, aa->height, &x0, &y0, &x1, &y1);
+
+    const Scene *scene = aa_tile_scene(job, index);
+    for (size_t by = y0; by < y1; by += AA_BLOCK) {
+        size_t by1 = by + AA_BLOCK < y1 ? by + AA_BLOCK : y1;
+        for (size_t bx = x0; bx < x1; bx += AA_BLOCK) {
+            size_t bx1 = bx + AA_BLOCK < x1 ? bx + AA_BLOCK : x1;
+            // The neighbours of the pixels of the block count too
+            Field_Bounds bounds = field_bounds(scene,
+                                               bx > 0 ? bx - 1 : bx, by > 0 ? by - 1 : by,
+                                               bx1 < aa->width ? bx1 + 1 : bx1,
+                                               by1 < aa->height ? by1 + 1 : by1);
+            bool mixed = bounds.hi >= FIELD_THRESHOLD && bounds.lo < FIELD_THRESHOLD;
+            aa->blocks[(by / AA_BLOCK)*aa_blocks_x(aa) + bx / AA_BLOCK] = mixed;
+            if (mixed) aa_find_edges(job, bx, by, bx1, by1);
+        }
+    }
+}
+
+// Supersamples the pixel if the contour may cross it. Returns false and leaves
+// the pixel alone otherwise.
+static ALWAYS_INLINE bool aa_pixel_with(const Scene *scene, size_t x, size_t y, Pixel32 *pixel,
+                                        Falloff falloff, Falloff_Func f)
+{
+    float px = (float) x + 0.5f, py = (float) y + 0.5f;
+    float s = 0.0f, gx = 0.0f, gy = 0.0f;
+    for (size_t i = 0; i < scene->count; ++i) {
+        float dx = scene->xs[i] - px;
+        float dy = scene->ys[i] - py;
+        float d2 = dx*dx + dy*dy;
+        float fi = f(d2, scene->inv_radii2[i]);
+        float k = scene->strengths[i] * falloff_slope(falloff, fi, d2, scene->inv_radii2[i]);
+        s += scene->strengths[i] * fi;
+        gx += k * dx;
+        gy += k * dy;
+    }
+    // The gradient is -2*(gx, gy) and the farthest corner is half a pixel away
+    // along both axes, so the factors cancel out
+    if (fabsf(s - FIELD_THRESHOLD) >= fabsf(gx) + fabsf(gy)) return false;
+
+    uint32_t sum_r = 0, sum_g = 0, sum_b = 0;
+    for (size_t sy = 0; sy < AA_SAMPLES; ++sy) {
+        float qy = (float) y + ((float) sy + 0.5f) / AA_SAMPLES;
+        for (size_t sx = 0; sx < AA_SAMPLES; ++sx) {
+            float qx = (float) x + ((float) sx + 0.5f) / AA_SAMPLES;
+            float ss = 0.0f, r = 0.0f, g = 0.0f, b = 0.0f;
+            for (size_t i = 0; i < scene->count; ++i) {
+                float dx = scene->xs[i] - qx;
+                float dy = scene->ys[i] - qy;
+                float si = scene->strengths[i] * f(dx*dx + dy*dy, scene->inv_radii2[i]);
+                ss += si;
+                r += si * scene->rs[i];
+                g += si * scene->gs[i];
+                b += si * scene->bs[i];
+            }
+            // The normal barely changes within the pixel, so the lit samples
+            // share the gradient of the center
+            Pixel32 color = scene->shading == SHADING_LIT
+                ? resolve_pixel_lit(scene, ss, r, g, b, gx, gy)
+                : resolve_pixel(scene, ss, r, g, b);
+            sum_r += (color >> (8 * 2)) & 0xFF;
+            sum_g += (color >> (8 * 1)) & 0xFF;
+            sum_b += (color >> (8 * 0)) & 0xFF;
+        }
+    }
+
+    const uint32_t n = AA_SAMPLES * AA_SAMPLES;
+    *pixel = (((sum_r + n/2) / n) << (8 * 2))
+           | (((sum_g + n/2) / n) << (8 * 1))
+           | (((sum_b + n/2) / n) << (8 * 0));
+    return true;
+}
+
+static bool aa_pixel(const Scene *scene, size_t x, size_t y, Pixel32 *pixel)
+{
+    switch (scene->falloff) {
+    case FALLOFF_INVERSE:
+        return aa_pixel_with(scene, x, y, pixel, FALLOFF_INVERSE, falloff_inverse);
+    case FALLOFF_INVERSE_Q2:
+        return aa_pixel_with(scene, x, y, pixel, FALLOFF_INVERSE_Q2, falloff_inverse_q2);
+    case FALLOFF_INVERSE_SQRTF:
+        return aa_pixel_with(scene, x, y, pixel, FALLOFF_INVERSE_SQRTF, falloff_inverse_sqrtf);
+    case FALLOFF_INVERSE4:
+        return aa_pixel_with(scene, x, y, pixel, FALLOFF_INVERSE4, falloff_inverse4);
+    case FALLOFF_WYVILL:
+        return aa_pixel_with(scene, x, y, pixel, FALLOFF_WYVILL, falloff_wyvill);
+    case FALLOFF_MURAKAMI:
+        return aa_pixel_with(scene, x, y, pixel, FALLOFF_MURAKAMI, falloff_murakami);
+    default:
+        assert(0 && "unreachable");
+        return false;
+    }
+}
+
+static void aa_resolve_tile(void *arg, size_t index)
+{
+    Aa_Job *job = arg;
+    Aa *aa = job->aa;
+    size_t x0, y0, x1, y1;
+    tile_rect(index, aa->width, aa->height, &x0, &y0, &x1, &y1);
+
+    const Scene *scene = aa_tile_scene(job, index);
+    size_t supersampled = 0;
+    for (size_t by = y0; by < y1; by += AA_BLOCK) {
+        size_t by1 = by + AA_BLOCK < y1 ? by + AA_BLOCK : y1;
+        for (size_t bx = x0; bx < x1; bx += AA_BLOCK) {
+            if (!aa->blocks[(by / AA_BLOCK)*aa_blocks_x(aa) + bx / AA_BLOCK]) continue;
+            size_t bx1 = bx + AA_BLOCK < x1 ? bx + AA_BLOCK : x1;
+            for (size_t y = by; y < by1; ++y) {
+                for (size_t x = bx; x < bx1; ++x) {
+                    if (!aa->edges[y*aa->width + x]) continue;
+                    supersampled += aa_pixel(scene, x, y, &job->pixels[y*aa->width + x]);
+                }
+            }
+        }
+    }
+    atomic_fetch_add(&job->supersampled, supersampled);
+}
+
+// Anti-aliases the edges of the rendered frame of all of the balls of the
+// scene. Returns the amount of the supersampled pixels.
+size_t aa_apply(Aa *aa, Pool *pool, Pixel32 *pixels, size_t width, size_t height,
+                const Scene *scene, const Bins *bins)
+{
+    if (aa->width != width || aa->height != height || aa->edges == NULL) {
+        free(aa->edges);
+        free(aa->blocks);
+        size_t blocks = ((width + AA_BLOCK - 1) / AA_BLOCK) * ((height + AA_BLOCK - 1) / AA_BLOCK);
+        aa->edges = malloc(width * height * sizeof(*aa->edges));
+        aa->blocks = malloc(blocks * sizeof(*aa->blocks));
+        if (aa->edges == NULL || aa->blocks == NULL) {
+            fprintf(stderr, "ERROR: could not allocate memory for the edges: %s\n",
+                    strerror(errno));
+            exit(1);
+        }
+        aa->width = width;
+        aa->height = height;
+    }
+
+    if (bins != NULL) scenes_grow(&aa->tile_scenes, &aa->tile_scenes_count, pool_threads(pool));
+
+    Aa_Job job = {
+        .aa = aa,
+        .pixels = pixels,
+        .scene = scene,
+        .bins = bins,
+    };
+    atomic_init(&job.supersampled, 0);
+    pool_run(pool, tiles_count(width, height), aa_find_edges_tile, &job);
+    pool_run(pool, tiles_count(width, height), aa_resolve_tile, &job);
+    return atomic_load(&job.supersampled);
+}
+
+void aa_free(Aa *aa)
+{
+    free(aa->edges);
+    free(aa->blocks);
+    aa->edges = NULL;
+    aa->blocks = NULL;
+    scenes_free(&aa->tile_scenes, &aa->tile_scenes_count);
+}
@@ -0,0 +1,1385 @@
+// Benchmarks of the building blocks of the renderer. Runs without a display.
+//
+// Usage: ./metaballs_bench <benchmark>
+#define _GNU_SOURCE
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <time.h>
+#include <string.h>
+#include <errno.h>
+#include <math.h>
+
+#define LA_IMPLEMENTATION
+#include "la.h"
+
+#include "prof.c"
+
+#include "scene.c"
+#include "fdiff.c"
+#include "unrolled.c"
+#include "blocked.c"
+#include "simd.c"
+#include "lut.c"
+#include "fixed.c"
+#include "swar.c"
+#include "kernels.c"
+#include "pool.c"
+#include "cache.c"
+#include "spans.c"
+#include "bins.c"
+#include "aa.c"
+#include "contour.c"
+#include "renderer.c"
+
+static double now_secs(void)
+{
+    struct timespec now;
+    if (clock_gettime(CLOCK_MONOTONIC, &now) < 0) {
+        fprintf(stderr, "ERROR: could not get current monotonic time: %s\n",
+                strerror(errno));
+        exit(1);
+    }
+    return (double) now.tv_sec + now.tv_nsec * 1e-9;
+}
+
+// Deterministic xorshift so every run benchmarks the same data
+static uint32_t rand_state = 0x12345678;
+
+static uint32_t rand_u32(void)
+{
+    rand_state ^= rand_state << 13;
+    rand_state ^= rand_state >> 17;
+    rand_state ^= rand_state << 5;
+    return rand_state;
+}
+
+static float rand_float(float lo, float hi)
+{
+    return lo + (hi - lo) * (float) (rand_u32() >> 8) / (float) (1 << 24);
+}
+
+// Falloff ////////////////////////////////////////////////////////////////////
+
+#define FALLOFF_SAMPLES 4096
+#define FALLOFF_MIN_SECS 0.25
+#define FALLOFF_WIDTH 256
+#define FALLOFF_HEIGHT 256
+#define FALLOFF_BALLS 8
+
+static float falloff_d2[FALLOFF_SAMPLES];
+static float falloff_inv_r2[FALLOFF_SAMPLES];
+static float falloff_out[FALLOFF_SAMPLES];
+static Scene falloff_scene;
+static Pixel32 falloff_pixels[FALLOFF_WIDTH * FALLOFF_HEIGHT];
+
+typedef struct {
+    Falloff falloff;
+    // Name of the implementation, also the name of the kernel that renders
+    // the falloff with it if there is one
+    const char *name;
+    void (*run)(const float *d2, const float *inv_r2, float *out, size_t n);
+    int (*supported)(void);
+} Falloff_Bench;
+
+#define FALLOFF_BENCH_SCALAR(f)                                                            \
+    static void bench_##f(const float *d2, const float *inv_r2, float *out, size_t n)      \
+    {                                                                                      \
+        for (size_t i = 0; i < n; ++i) out[i] = f(d2[i], inv_r2[i]);                       \
+    }
+
+FALLOFF_BENCH_SCALAR(falloff_inverse)
+FALLOFF_BENCH_SCALAR(falloff_inverse_q2)
+FALLOFF_BENCH_SCALAR(falloff_inverse_sqrtf)
+FALLOFF_BENCH_SCALAR(falloff_inverse4)
+FALLOFF_BENCH_SCALAR(falloff_wyvill)
+FALLOFF_BENCH_SCALAR(falloff_murakami)
+FALLOFF_BENCH_SCALAR(falloff_lut_inverse)
+FALLOFF_BENCH_SCALAR(falloff_lut_inverse4)
+
+#ifdef SIMD_X86
+#define FALLOFF_BENCH_SSE2(f)                                                              \
+    __attribute__((target("sse2")))                                                        \
+    static void bench_##f(const float *d2, const float *inv_r2, float *out, size_t n)      \
+    {                                                                                      \
+        for (size_t i = 0; i < n; i += 4) {                                                \
+            _mm_storeu_ps(&out[i], f(_mm_loadu_ps(&d2[i]), _mm_loadu_ps(&inv_r2[i])));     \
+        }                                                                                  \
+    }
+
+#define FALLOFF_BENCH_AVX2(f)                                                              \
+    __attribute__((target("avx2")))                                                        \
+    static void bench_##f(const float *d2, const float *inv_r2, float *out, size_t n)      \
+    {                                                                                      \
+        for (size_t i = 0; i < n; i += 8) {                                                \
+            _mm256_storeu_ps(&out[i], f(_mm256_loadu_ps(&d2[i]), _mm256_loadu_ps(&inv_r2[i]))); \
+        }                                                                                  \
+    }
+
+#define FALLOFF_BENCH_AVX512(f)                                                            \
+    __attribute__((target("avx512f")))                                                     \
+    static void bench_##f(const float *d2, const float *inv_r2, float *out, size_t n)      \
+    {                                                                                      \
+        for (size_t i = 0; i < n; i += 16) {                                               \
+            _mm512_storeu_ps(&out[i], f(_mm512_loadu_ps(&d2[i]), _mm512_loadu_ps(&inv_r2[i]))); \
+        }                                                                                  \
+    }
+
+FALLOFF_BENCH_SSE2(falloff_inverse_sse2)
+FALLOFF_BENCH_SSE2(falloff_inverse_q2_sse2)
+FALLOFF_BENCH_SSE2(falloff_inverse_sqrtf_sse2)
+FALLOFF_BENCH_SSE2(falloff_inverse4_sse2)
+FALLOFF_BENCH_SSE2(falloff_wyvill_sse2)
+FALLOFF_BENCH_SSE2(falloff_murakami_sse2)
+FALLOFF_BENCH_AVX2(falloff_inverse_avx2)
+FALLOFF_BENCH_AVX2(falloff_inverse_q2_avx2)
+FALLOFF_BENCH_AVX2(falloff_inverse_sqrtf_avx2)
+FALLOFF_BENCH_AVX2(falloff_inverse4_avx2)
+FALLOFF_BENCH_AVX2(falloff_wyvill_avx2)
+FALLOFF_BENCH_AVX2(falloff_murakami_avx2)
+FALLOFF_BENCH_AVX512(falloff_inverse_avx512)
+FALLOFF_BENCH_AVX512(falloff_inverse_q2_avx512)
+FALLOFF_BENCH_AVX512(falloff_inverse_sqrtf_avx512)
+FALLOFF_BENCH_AVX512(falloff_inverse4_avx512)
+FALLOFF_BENCH_AVX512(falloff_wyvill_avx512)
+FALLOFF_BENCH_AVX512(falloff_murakami_avx512)
+
+__attribute__((target("avx2")))
+static void bench_falloff_lut_inverse_avx2(const float *d2, const float *inv_r2, float *out, size_t n)
+{
+    (void) inv_r2;
+    for (size_t i = 0; i < n; i += 8) {
+        _mm256_storeu_ps(&out[i], falloff_lut_avx2(falloff_lut_inv_sqrt, _mm256_loadu_ps(&d2[i])));
+    }
+}
+
+__attribute__((target("avx2")))
+static void bench_falloff_lut_inverse4_avx2(const float *d2, const float *inv_r2, float *out, size_t n)
+{
+    (void) inv_r2;
+    for (size_t i = 0; i < n; i += 8) {
+        _mm256_storeu_ps(&out[i], falloff_lut_avx2(falloff_lut_inv_square, _mm256_loadu_ps(&d2[i])));
+    }
+}
+#endif // SIMD_X86
+
+static const Falloff_Bench falloff_benches[] = {
+    {FALLOFF_INVERSE, "scalar", bench_falloff_inverse, NULL},
+    {FALLOFF_INVERSE, "lut", bench_falloff_lut_inverse, NULL},
+#ifdef SIMD_X86
+    {FALLOFF_INVERSE, "sse2", bench_falloff_inverse_sse2, cpu_has_sse2},
+    {FALLOFF_INVERSE, "avx2", bench_falloff_inverse_avx2, cpu_has_avx2},
+    {FALLOFF_INVERSE, "avx2-lut", bench_falloff_lut_inverse_avx2, cpu_has_avx2},
+    {FALLOFF_INVERSE, "avx512", bench_falloff_inverse_avx512, cpu_has_avx512},
+#endif // SIMD_X86
+    {FALLOFF_INVERSE_Q2, "scalar", bench_falloff_inverse_q2, NULL},
+#ifdef SIMD_X86
+    {FALLOFF_INVERSE_Q2, "sse2", bench_falloff_inverse_q2_sse2, cpu_has_sse2},
+    {FALLOFF_INVERSE_Q2, "avx2", bench_falloff_inverse_q2_avx2, cpu_has_avx2},
+    {FALLOFF_INVERSE_Q2, "avx512", bench_falloff_inverse_q2_avx512, cpu_has_avx512},
+#endif // SIMD_X86
+    {FALLOFF_INVERSE_SQRTF, "scalar", bench_falloff_inverse_sqrtf, NULL},
+#ifdef SIMD_X86
+    {FALLOFF_INVERSE_SQRTF, "sse2", bench_falloff_inverse_sqrtf_sse2, cpu_has_sse2},
+    {FALLOFF_INVERSE_SQRTF, "avx2", bench_falloff_inverse_sqrtf_avx2, cpu_has_avx2},
+    {FALLOFF_INVERSE_SQRTF, "avx512", bench_falloff_inverse_sqrtf_avx512, cpu_has_avx512},
+#endif // SIMD_X86
+    {FALLOFF_INVERSE4, "scalar", bench_falloff_inverse4, NULL},
+    {FALLOFF_INVERSE4, "lut", bench_falloff_lut_inverse4, NULL},
+#ifdef SIMD_X86
+    {FALLOFF_INVERSE4, "sse2", bench_falloff_inverse4_sse2, cpu_has_sse2},
+    {FALLOFF_INVERSE4, "avx2", bench_falloff_inverse4_avx2, cpu_has_avx2},
+    {FALLOFF_INVERSE4, "avx2-lut", bench_falloff_lut_inverse4_avx2, cpu_has_avx2},
+    {FALLOFF_INVERSE4, "avx512", bench_falloff_inverse4_avx512, cpu_has_avx512},
+#endif // SIMD_X86
+    {FALLOFF_WYVILL, "scalar", bench_falloff_wyvill, NULL},
+#ifdef SIMD_X86
+    {FALLOFF_WYVILL, "sse2", bench_falloff_wyvill_sse2, cpu_has_sse2},
+    {FALLOFF_WYVILL, "avx2", bench_falloff_wyvill_avx2, cpu_has_avx2},
+    {FALLOFF_WYVILL, "avx512", bench_falloff_wyvill_avx512, cpu_has_avx512},
+#endif // SIMD_X86
+    {FALLOFF_MURAKAMI, "scalar", bench_falloff_murakami, NULL},
+#ifdef SIMD_X86
+    {FALLOFF_MURAKAMI, "sse2", bench_falloff_murakami_sse2, cpu_has_sse2},
+    {FALLOFF_MURAKAMI, "avx2", bench_falloff_murakami_avx2, cpu_has_avx2},
+    {FALLOFF_MURAKAMI, "avx512", bench_falloff_murakami_avx512, cpu_has_avx512},
+#endif // SIMD_X86
+};
+#define FALLOFF_BENCHES_COUNT (sizeof(falloff_benches)/sizeof(falloff_benches[0]))
+
+static double falloff_reference(Falloff falloff, double d2, double inv_r2)
+{
+    double q = d2 * inv_r2;
+    switch (falloff) {
+    case FALLOFF_INVERSE:
+    case FALLOFF_INVERSE_Q2:
+    case FALLOFF_INVERSE_SQRTF:
+        return 1.0 / sqrt(d2);
+    case FALLOFF_INVERSE4:
+        return 1.0 / (d2 * d2);
+    case FALLOFF_WYVILL:
+        if (q >= 1.0) return 0.0;
+        return 1.0 - 4.0/9.0*q*q*q + 17.0/9.0*q*q - 22.0/9.0*q;
+    case FALLOFF_MURAKAMI:
+        if (q >= 1.0) return 0.0;
+        return (1.0 - q) * (1.0 - q);
+    default:
+        assert(0 && "unreachable");
+        return 0.0;
+    }
+}
+
+// Cost of rendering a small scene of the falloff with the kernel of the same
+// name as the implementation, or a negative value if there is no such kernel
+static double falloff_render_cost(const Falloff_Bench *bench)
+{
+    const Kernel *kernel = kernel_by_name(bench->name);
+    if (kernel == NULL || !(kernel->falloffs & (1u << bench->falloff))) return -1.0;
+
+    scene_set_falloff(&falloff_scene, bench->falloff);
+    size_t frames = 0;
+    double begin = now_secs();
+    double elapsed = 0.0;
+    do {
+        render_scene(falloff_pixels, FALLOFF_WIDTH, FALLOFF_HEIGHT, &falloff_scene, kernel);
+        frames += 1;
+        elapsed = now_secs() - begin;
+    } while (elapsed < FALLOFF_MIN_SECS);
+    return elapsed * 1e9 / ((double) frames * FALLOFF_WIDTH * FALLOFF_HEIGHT);
+}
+
+// Cost and accuracy of every implementation of every falloff. The error of the
+// 1/r and 1/r^4 falloffs is relative to the exact value, the error of the
+// compact ones is relative to their peak of 1, since they go down to zero.
+static void bench_falloffs(void)
+{
+    // Squared distances between the points of a 1600x900 frame, with the radii
+    // of the balls such that q = r^2/R^2 is spread over [0, 1.25), so the
+    // compact falloffs are sampled inside and a bit outside of their support
+    for (size_t i = 0; i < FALLOFF_SAMPLES; ++i) {
+        float dx = rand_float(-1600.0f, 1600.0f);
+        float dy = rand_float(-900.0f, 900.0f);
+        falloff_d2[i] = dx*dx + dy*dy + 0.5f;
+        falloff_inv_r2[i] = rand_float(0.0f, 1.25f) / falloff_d2[i];
+    }
+
+    scene_clear(&falloff_scene, 0x5555AA);
+    for (size_t i = 0; i < FALLOFF_BALLS; ++i) {
+        V2f pos = v2f(rand_float(0.0f, FALLOFF_WIDTH), rand_float(0.0f, FALLOFF_HEIGHT));
+        scene_push_ball(&falloff_scene, pos, 1.0f / FALLOFF_BALLS, rand_u32() & 0xFFFFFF);
+    }
+
+    printf("%-14s %-10s %10s %12s %12s %10s\n",
+           "falloff", "impl", "ns/eval", "max err", "mean err", "ns/pixel");
+    for (size_t i = 0; i < FALLOFF_BENCHES_COUNT; ++i) {
+        const Falloff_Bench *bench = &falloff_benches[i];
+        const char *falloff = falloff_names[bench->falloff];
+        if (bench->supported && !bench->supported()) {
+            printf("%-14s %-10s %10s\n", falloff, bench->name, "unsupported");
+            continue;
+        }
+
+        size_t iterations = 0;
+        double begin = now_secs();
+        double elapsed = 0.0;
+        do {
+            bench->run(falloff_d2, falloff_inv_r2, falloff_out, FALLOFF_SAMPLES);
+            iterations += 1;
+            elapsed = now_secs() - begin;
+        } while (elapsed < FALLOFF_MIN_SECS);
+
+        double max_err = 0.0, sum_err = 0.0;
+        for (size_t j = 0; j < FALLOFF_SAMPLES; ++j) {
+            double expected = falloff_reference(bench->falloff, falloff_d2[j], falloff_inv_r2[j]);
+            double err = fabs(falloff_out[j] - expected);
+            if (!falloff_is_compact(bench->falloff)) err /= expected;
+            if (err > max_err) max_err = err;
+            sum_err += err;
+        }
+
+        printf("%-14s %-10s %10.3f %12.3e %12.3e",
+               falloff, bench->name,
+               elapsed * 1e9 / ((double) iterations * FALLOFF_SAMPLES),
+               max_err,
+               sum_err / FALLOFF_SAMPLES);
+        double cost = falloff_render_cost(bench);
+        if (cost < 0.0) {
+            printf(" %10s\n", "-");
+        } else {
+            printf(" %10.3f\n", cost);
+        }
+    }
+}
+
+// Kernels ////////////////////////////////////////////////////////////////////
+
+#define KERNELS_WIDTH 256
+#define KERNELS_HEIGHT 256
+#define KERNELS_MIN_SECS 0.25
+
+static Scene kernels_scene;
+static Pixel32 kernels_pixels[KERNELS_WIDTH * KERNELS_HEIGHT];
+
+// Cost of every kernel alone on a single thread, for several amounts of balls
+static void bench_kernels(void)
+{
+    static const size_t counts[] = {1, 2, 4, 8, 16, 64, 256, 1024};
+
+    printf("%-8s", "balls");
+    for (size_t k = 0; k < KERNELS_COUNT; ++k) {
+        if (!kernel_supported(&kernels[k])) continue;
+        printf(" %10s", kernels[k].name);
+    }
+    printf("   (ns/pixel)\n");
+
+    for (size_t i = 0; i < sizeof(counts)/sizeof(counts[0]); ++i) {
+        scene_clear(&kernels_scene, 0x5555AA);
+        for (size_t j = 0; j < counts[i]; ++j) {
+            V2f pos = v2f(rand_float(0.0f, KERNELS_WIDTH), rand_float(0.0f, KERNELS_HEIGHT));
+            // Keep the total strength the same, so the picture stays about as
+            // busy with any amount of balls
+            scene_push_ball(&kernels_scene, pos, 1.0f / (float) counts[i], rand_u32() & 0xFFFFFF);
+        }
+
+        printf("%-8zu", counts[i]);
+        for (size_t k = 0; k < KERNELS_COUNT; ++k) {
+            const Kernel *kernel = &kernels[k];
+            if (!kernel_supported(kernel)) continue;
+
+            size_t frames = 0;
+            double begin = now_secs();
+            double elapsed = 0.0;
+            do {
+                render_scene(kernels_pixels, KERNELS_WIDTH, KERNELS_HEIGHT, &kernels_scene, kernel);
+                frames += 1;
+                elapsed = now_secs() - begin;
+            } while (elapsed < KERNELS_MIN_SECS);
+
+            printf(" %10.3f", elapsed * 1e9 / ((double) frames * KERNELS_WIDTH * KERNELS_HEIGHT));
+        }
+        printf("\n");
+    }
+}
+
+// Bins ///////////////////////////////////////////////////////////////////////
+
+#define BINS_WIDTH 1600
+#define BINS_HEIGHT 900
+#define BINS_MIN_SECS 0.5
+
+#define BINS_CHECK_BALLS 100
+
+static Scene bins_scene;
+static Pixel32 bins_pixels[BINS_WIDTH * BINS_HEIGHT];
+static Pixel32 bins_expected[BINS_WIDTH * BINS_HEIGHT];
+
+static double bench_frame(Renderer *renderer)
+{
+    size_t frames = 0;
+    double begin = now_secs();
+    double elapsed = 0.0;
+    do {
+        renderer_render(renderer, bins_pixels, BINS_WIDTH, BINS_HEIGHT, &bins_scene);
+        frames += 1;
+        elapsed = now_secs() - begin;
+    } while (elapsed < BINS_MIN_SECS);
+    return elapsed * 1e3 / (double) frames;
+}
+
+// Amount of the pixels of the renderer with the bins different from the ones
+// without them
+static size_t bins_check(Renderer *renderer)
+{
+    renderer->use_bins = false;
+    renderer_render(renderer, bins_expected, BINS_WIDTH, BINS_HEIGHT, &bins_scene);
+    renderer->use_bins = true;
+    renderer_render(renderer, bins_pixels, BINS_WIDTH, BINS_HEIGHT, &bins_scene);
+    size_t differ = 0;
+    for (size_t i = 0; i < BINS_WIDTH * BINS_HEIGHT; ++i) {
+        if (bins_pixels[i] != bins_expected[i]) differ += 1;
+    }
+    return differ;
+}
+
+static void bench_bins(void)
+{
+    static const size_t counts[] = {10, 100, 1000, 10000};
+
+    Pool pool;
+    pool_init(&pool, pool_default_threads());
+    Renderer renderer = {0};
+    renderer_init(&renderer, kernel_best(), &pool);
+
+    // The binning only leaves out the balls that can't reach a tile, so it
+    // must not change a single pixel, also with the negative balls around and
+    // the edges supersampled from the same bins
+    size_t failed = 0;
+    for (Falloff falloff = 0; falloff < COUNT_FALLOFFS; ++falloff) {
+        if (!falloff_is_compact(falloff)) continue;
+        scene_clear(&bins_scene, 0x5555AA);
+        scene_set_falloff(&bins_scene, falloff);
+        for (size_t j = 0; j < BINS_CHECK_BALLS; ++j) {
+            V2f pos = v2f(rand_float(0.0f, BINS_WIDTH), rand_float(0.0f, BINS_HEIGHT));
+            // The default radii, 20 to 60 pixels
+            float strength = rand_float(0.1f, 0.3f);
+            if (j % 3 == 2) strength = -strength;
+            scene_push_ball(&bins_scene, pos, strength, rand_u32() & 0xFFFFFF);
+        }
+        for (int aa = 0; aa < 2; ++aa) {
+            renderer.use_aa = aa;
+            size_t differ = bins_check(&renderer);
+            if (differ > 0) {
+                fprintf(stderr, "ERROR: %zu pixels of %zu balls of the %s falloff%s differ with the bins\n",
+                        differ, (size_t) BINS_CHECK_BALLS, falloff_names[falloff], aa ? " with -aa" : "");
+                failed += 1;
+            }
+        }
+    }
+    renderer.use_aa = false;
+    if (failed > 0) exit(1);
+
+    printf("%-8s %12s %12s %14s %14s\n", "balls", "avg/tile", "worst/tile", "ms/frame", "no bins");
+    for (size_t i = 0; i < sizeof(counts)/sizeof(counts[0]); ++i) {
+        // Balls of the same size spread evenly, so the lists grow with the
+        // density of the balls
+        scene_clear(&bins_scene, 0x5555AA);
+        scene_set_falloff(&bins_scene, FALLOFF_MURAKAMI);
+        for (size_t j = 0; j < counts[i]; ++j) {
+            V2f pos = v2f(rand_float(0.0f, BINS_WIDTH), rand_float(0.0f, BINS_HEIGHT));
+            size_t ball = scene_push_ball(&bins_scene, pos, 1.0f, rand_u32() & 0xFFFFFF);
+            scene_set_radius(&bins_scene, ball, rand_float(16.0f, 64.0f));
+        }
+
+        renderer.use_bins = true;
+        double binned = bench_frame(&renderer);
+        float average = bins_average(&renderer.bins);
+        size_t longest = renderer.bins.longest;
+
+        renderer.use_bins = false;
+        double unbinned = bench_frame(&renderer);
+
+        printf("%-8zu %12.2f %12zu %14.3f %14.3f\n", counts[i], average, longest, binned, unbinned);
+    }
+
+    renderer_free(&renderer);
+    pool_destroy(&pool);
+}
+
+// Shading ////////////////////////////////////////////////////////////////////
+
+#define SHADING_WIDTH 256
+#define SHADING_HEIGHT 256
+#define SHADING_MIN_SECS 0.25
+
+static Scene shading_scene;
+static Pixel32 shading_pixels[SHADING_WIDTH * SHADING_HEIGHT];
+
+// Cost of every shading with every kernel implementing more than the blend one
+// on a single thread, and its overhead over the blend shading
+static void bench_shadings(void)
+{
+    static const size_t counts[] = {2, 16};
+
+    printf("%-8s %-10s", "balls", "kernel");
+    for (Shading sh = 0; sh < COUNT_SHADINGS; ++sh) {
+        printf(" %18s", shading_names[sh]);
+    }
+    printf("   (ns/pixel)\n");
+
+    for (size_t i = 0; i < sizeof(counts)/sizeof(counts[0]); ++i) {
+        scene_clear(&shading_scene, 0x181818);
+        for (size_t j = 0; j < counts[i]; ++j) {
+            V2f pos = v2f(rand_float(0.0f, SHADING_WIDTH), rand_float(0.0f, SHADING_HEIGHT));
+            scene_push_ball(&shading_scene, pos, 1.0f / (float) counts[i], rand_u32() & 0xFFFFFF);
+        }
+
+        for (size_t k = 0; k < KERNELS_COUNT; ++k) {
+            const Kernel *kernel = &kernels[k];
+            if (kernel->shadings == BLEND_ONLY || !kernel_supported(kernel)) continue;
+
+            printf("%-8zu %-10s", counts[i], kernel->name);
+            double blend = 0.0;
+            for (Shading sh = 0; sh < COUNT_SHADINGS; ++sh) {
+                if (!(kernel->shadings & (1u << sh))) {
+                    printf(" %18s", "-");
+                    continue;
+                }
+                scene_set_shading(&shading_scene, sh);
+                size_t frames = 0;
+                double begin = now_secs();
+                double elapsed = 0.0;
+                do {
+                    render_scene(shading_pixels, SHADING_WIDTH, SHADING_HEIGHT, &shading_scene, kernel);
+                    frames += 1;
+                    elapsed = now_secs() - begin;
+                } while (elapsed < SHADING_MIN_SECS);
+
+                double cost = elapsed * 1e9 / ((double) frames * SHADING_WIDTH * SHADING_HEIGHT);
+                if (sh == SHADING_BLEND) {
+                    blend = cost;
+                    printf(" %18.3f", cost);
+                } else {
+                    printf(" %9.3f (%+5.1f%%)", cost, (cost / blend - 1.0) * 100.0);
+                }
+            }
+            printf("\n");
+        }
+        scene_set_shading(&shading_scene, SHADING_BLEND);
+    }
+}
+
+// Contour /////////////////////////////////////////////////////////////////////
+
+#define CONTOUR_WIDTH 1600
+#define CONTOUR_HEIGHT 900
+#define CONTOUR_MIN_SECS 0.25
+
+static Scene contour_scene;
+static Pixel32 contour_pixels[CONTOUR_WIDTH * CONTOUR_HEIGHT];
+
+// Time of the extraction of the contour at several sizes of the cells against
+// rendering the raster of the same scene
+static void bench_contour(void)
+{
+    static const size_t counts[] = {2, 16, 128};
+    static const size_t cells[] = {2, 4, 8, 16};
+    static const Falloff falloffs[] = {FALLOFF_INVERSE, FALLOFF_MURAKAMI};
+
+    Pool pool;
+    pool_init(&pool, pool_default_threads());
+    Renderer renderer = {0};
+    renderer_init(&renderer, kernel_best(), &pool);
+    Contour contour = {0};
+
+    printf("%-8s %-10s %8s %10s %12s %14s\n", "balls", "falloff", "cell", "polylines", "points", "ms/extraction");
+    for (size_t i = 0; i < sizeof(counts)/sizeof(counts[0]); ++i) {
+        for (size_t f = 0; f < sizeof(falloffs)/sizeof(falloffs[0]); ++f) {
+            Falloff falloff = falloffs[f];
+            scene_clear(&contour_scene, 0x5555AA);
+            scene_set_falloff(&contour_scene, falloff);
+            float radius = 800.0f / sqrtf((float) counts[i]);
+            for (size_t j = 0; j < counts[i]; ++j) {
+                V2f pos = v2f(rand_float(0.0f, CONTOUR_WIDTH), rand_float(0.0f, CONTOUR_HEIGHT));
+                size_t ball = scene_push_ball(&contour_scene, pos, 1.0f / (float) counts[i], rand_u32() & 0xFFFFFF);
+                scene_set_radius(&contour_scene, ball, radius);
+            }
+
+            for (size_t k = 0; k < sizeof(cells)/sizeof(cells[0]); ++k) {
+                size_t frames = 0;
+                double begin = now_secs();
+                double elapsed = 0.0;
+                do {
+                    contour_extract(&contour, &pool, CONTOUR_WIDTH, CONTOUR_HEIGHT, cells[k], &contour_scene);
+                    frames += 1;
+                    elapsed = now_secs() - begin;
+                } while (elapsed < CONTOUR_MIN_SECS);
+                printf("%-8zu %-10s %8zu %10zu %12zu %14.3f\n", counts[i], falloff_names[falloff], cells[k],
+                       contour.count, contour.points_count, elapsed * 1e3 / (double) frames);
+            }
+
+            size_t frames = 0;
+            double begin = now_secs();
+            double elapsed = 0.0;
+            do {
+                renderer_render(&renderer, contour_pixels, CONTOUR_WIDTH, CONTOUR_HEIGHT, &contour_scene);
+                frames += 1;
+                elapsed = now_secs() - begin;
+            } while (elapsed < CONTOUR_MIN_SECS);
+            printf("%-8zu %-10s %8s %10s %12s %14.3f\n", counts[i], falloff_names[falloff], "raster", "-", "-",
+                   elapsed * 1e3 / (double) frames);
+        }
+    }
+
+    contour_free(&contour);
+    renderer_free(&renderer);
+    pool_destroy(&pool);
+}
+
+// Scenes //////////////////////////////////////////////////////////////////////
+
+#define SCENES_MIN_SECS 0.25
+#define SCENES_MIN_FRAMES 10
+#define SCENES_MAX_FRAMES 1000
+// The cells whose frame is predicted to take longer are skipped, see
+// bench_scenes()
+#define SCENES_MAX_FRAME_SECS 0.5
+
+typedef struct {
+    size_t width, height;
+} Resolution;
+
+static const Resolution scenes_resolutions[] = {
+    {640, 360}, {1280, 720}, {1920, 1080}, {3840, 2160}, {7680, 4320},
+};
+#define SCENES_RESOLUTIONS_COUNT (sizeof(scenes_resolutions)/sizeof(scenes_resolutions[0]))
+static const size_t scenes_counts[] = {2, 16, 128, 1000, 10000};
+#define SCENES_COUNTS_COUNT (sizeof(scenes_counts)/sizeof(scenes_counts[0]))
+
+static Scene scenes_scene;
+static double scenes_times[SCENES_MAX_FRAMES];
+
+// The same picture at any resolution: the balls are spread evenly over the
+// frame and cover about a half of it with any amount of them
+static void scenes_build(size_t width, size_t height, size_t count, Falloff falloff)
+{
+    rand_state = 0x12345678;
+    scene_clear(&scenes_scene, 0x5555AA);
+    scene_set_falloff(&scenes_scene, falloff);
+    for (size_t j = 0; j < count; ++j) {
+        V2f pos = v2f(rand_float(0.0f, width), rand_float(0.0f, height));
+        if (falloff_is_compact(falloff)) {
+            size_t ball = scene_push_ball(&scenes_scene, pos, 1.0f, rand_u32() & 0xFFFFFF);
+            scene_set_radius(&scenes_scene, ball, 0.5f * height / sqrtf((float) count));
+        } else {
+            // As much as 2 balls reaching the threshold at a quarter of the
+            // height, shared by all of them
+            scene_push_ball(&scenes_scene, pos, FIELD_THRESHOLD * 0.5f * height / (float) count,
+                            rand_u32() & 0xFFFFFF);
+        }
+    }
+}
+
+static int compare_doubles(const void *a, const void *b)
+{
+    double x = *(const double*) a, y = *(const double*) b;
+    return (x > y) - (x < y);
+}
+
+// Renders frames of the scene with the first ball going around the center of
+// the frame like in the headless backend of the app, until both
+// SCENES_MIN_SECS and SCENES_MIN_FRAMES are reached. Returns the amount of the
+// frames, their times are in scenes_times.
+static size_t scenes_run(Renderer *renderer, Pixel32 *pixels, size_t width, size_t height)
+{
+    size_t frames = 0;
+    double elapsed = 0.0;
+    while (frames < SCENES_MAX_FRAMES && (frames < SCENES_MIN_FRAMES || elapsed < SCENES_MIN_SECS)) {
+        float t = (float) frames / 60.0f;
+        scene_move_ball(&scenes_scene, 0,
+                        v2f_sum(v2f_mul(v2f(width, height), v2ff(0.5)),
+                                v2f_mul(v2f(cosf(4.0f*t), sinf(4.0f*t)), v2ff(height * 0.25f))));
+        double begin = now_secs();
+        renderer_render(renderer, pixels, width, height, &scenes_scene);
+        scenes_times[frames] = now_secs() - begin;
+        elapsed += scenes_times[frames];
+        frames += 1;
+    }
+    return frames;
+}
+
+// The whole frame of the renderer with all of the threads for the matrix of
+// the resolutions, the amounts of the balls, the falloffs and the kernels,
+// printed as CSV. The kernels that fall back to scalar for a falloff are left
+// out. Frames longer than SCENES_MAX_FRAME_SECS would take too long to repeat
+// enough times, so the cost of a cell is predicted from the previous one of the
+// same falloff and kernel and the cells over the limit are skipped. The
+// optional arguments narrow the matrix down to the given kernels and falloffs.
+static void bench_scenes(int argc, char **argv)
+{
+    unsigned int kernels_mask = 0, falloffs_mask = 0;
+    for (int i = 0; i < argc; ++i) {
+        const Kernel *kernel = kernel_by_name(argv[i]);
+        if (kernel != NULL) {
+            kernels_mask |= 1u << (kernel - kernels);
+            continue;
+        }
+        Falloff falloff = 0;
+        while (falloff < COUNT_FALLOFFS && strcmp(falloff_names[falloff], argv[i]) != 0) falloff += 1;
+        if (falloff >= COUNT_FALLOFFS) {
+            fprintf(stderr, "ERROR: %s is neither a kernel nor a falloff\n", argv[i]);
+            exit(1);
+        }
+        falloffs_mask |= 1u << falloff;
+    }
+    if (kernels_mask == 0) kernels_mask = (1u << KERNELS_COUNT) - 1;
+    if (falloffs_mask == 0) falloffs_mask = ALL_FALLOFFS;
+
+    const Resolution *largest = &scenes_resolutions[SCENES_RESOLUTIONS_COUNT - 1];
+    Pixel32 *pixels = malloc(largest->width * largest->height * sizeof(Pixel32));
+    if (pixels == NULL) {
+        fprintf(stderr, "ERROR: could not allocate memory for pixels: %s\n",
+                strerror(errno));
+        exit(1);
+    }
+
+    size_t threads = pool_default_threads();
+    Pool pool;
+    pool_init(&pool, threads);
+    Renderer renderer = {0};
+    renderer_init(&renderer, kernel_best(), &pool);
+
+    printf("width,height,balls,falloff,kernel,threads,frames,ns_per_pixel,fps,min_ms,median_ms,p99_ms\n");
+    for (Falloff falloff = 0; falloff < COUNT_FALLOFFS; ++falloff) {
+        if (!(falloffs_mask & (1u << falloff))) continue;
+        for (size_t k = 0; k < KERNELS_COUNT; ++k) {
+            const Kernel *kernel = &kernels[k];
+            if (!(kernels_mask & (1u << k)) || !kernel_supported(kernel)) continue;
+            if (!(kernel->falloffs & (1u << falloff))) continue;
+            renderer.kernel = kernel;
+
+            // ns/pixel of the smallest resolution with the previous amount of
+            // balls, measured or predicted
+            double base = 0.0;
+            for (size_t c = 0; c < SCENES_COUNTS_COUNT; ++c) {
+                size_t count = scenes_counts[c];
+                // The compact balls cover the same area with any amount of
+                // them, while every inverse ball reaches every pixel
+                double predicted = base;
+                if (c > 0 && !falloff_is_compact(falloff)) {
+                    predicted *= (double) count / (double) scenes_counts[c - 1];
+                }
+
+                for (size_t r = 0; r < SCENES_RESOLUTIONS_COUNT; ++r) {
+                    size_t width = scenes_resolutions[r].width, height = scenes_resolutions[r].height;
+                    if (predicted * 1e-9 * width * height > SCENES_MAX_FRAME_SECS) {
+                        fprintf(stderr, "INFO: skipping %zux%zu with %zu balls of %s with %s: "
+                                "predicted %.0f ms per frame\n", width, height, count,
+                                falloff_names[falloff], kernel->name, predicted * 1e-6 * width * height);
+                        if (r == 0) base = predicted;
+                        continue;
+                    }
+
+                    scenes_build(width, height, count, falloff);
+                    size_t frames = scenes_run(&renderer, pixels, width, height);
+                    double total = 0.0;
+                    for (size_t i = 0; i < frames; ++i) total += scenes_times[i];
+                    qsort(scenes_times, frames, sizeof(scenes_times[0]), compare_doubles);
+                    // Nearest rank
+                    size_t p99 = (frames * 99 + 99) / 100 - 1;
+
+                    predicted = total * 1e9 / ((double) frames * width * height);
+                    if (r == 0) base = predicted;
+                    printf("%zu,%zu,%zu,%s,%s,%zu,%zu,%.3f,%.2f,%.3f,%.3f,%.3f\n",
+                           width, height, count, falloff_names[falloff], kernel->name, threads,
+                           frames, predicted, frames / total,
+                           scenes_times[0] * 1e3, scenes_times[frames / 2] * 1e3,
+                           scenes_times[p99] * 1e3);
+                    fflush(stdout);
+                }
+            }
+        }
+    }
+
+    renderer_free(&renderer);
+    pool_destroy(&pool);
+    free(pixels);
+}
+
+// Golden //////////////////////////////////////////////////////////////////////
+
+// Odd sizes, so the SIMD kernels go through their tails
+#define GOLDEN_WIDTH 253
+#define GOLDEN_HEIGHT 181
+// The most a channel of a ball pixel may differ from scalar, see
+// golden_tolerance() for the palette shading
+#define GOLDEN_TOLERANCE 1
+// A pixel may flip between the background and a ball only where the exact
+// field is within this fraction of FIELD_THRESHOLD, and at most
+// GOLDEN_MAX_FLIPS of them in a frame
+#define GOLDEN_FLIP_MARGIN 0.002
+// The table of lut is indexed by r^2 with a relative step of 2^-7, which 1/r^4
+// turns into an error of up to 2^-7 (see lut.c)
+#define GOLDEN_LUT_INVERSE4_FLIP_MARGIN 0.008
+#define GOLDEN_MAX_FLIPS 64
+// More than one even on a single CPU, so the tiles are rendered in any order
+#define GOLDEN_THREADS 4
+
+typedef enum {
+    GOLDEN_PAIR = 0,
+    GOLDEN_EIGHT,
+    GOLDEN_CROWD,
+    GOLDEN_BORDER,
+    GOLDEN_FAINT,
+    GOLDEN_UNROUNDED,
+    GOLDEN_NEGATIVE,
+    GOLDEN_BITE,
+    COUNT_GOLDEN_SCENES,
+} Golden_Scene;
+
+static const char *golden_scene_names[COUNT_GOLDEN_SCENES] = {
+    [GOLDEN_PAIR] = "pair",
+    [GOLDEN_EIGHT] = "eight",
+    [GOLDEN_CROWD] = "crowd",
+    [GOLDEN_BORDER] = "border",
+    [GOLDEN_FAINT] = "faint",
+    [GOLDEN_UNROUNDED] = "unrounded",
+    [GOLDEN_NEGATIVE] = "negative",
+    [GOLDEN_BITE] = "bite",
+};
+
+// The options of the renderer as the flags of metaballs, the renderer is
+// compared in every combination of them
+#define GOLDEN_OPTIONS 5
+#define GOLDEN_AA (1u << 4)
+static const char *golden_option_flags[GOLDEN_OPTIONS] = {
+    "-no-spans",
+    "-no-quadtree",
+    "-no-bins",
+    "-no-static-cache",
+    "-aa",
+};
+
+// Frames of every combination of the options: the first one builds the static
+// cache and the second one moves a dynamic ball and reuses it
+#define GOLDEN_FRAMES 2
+
+static Scene golden_scene;
+// Where golden_build() put the first ball, see golden_move()
+static V2f golden_first;
+static Pixel32 golden_expected[GOLDEN_WIDTH * GOLDEN_HEIGHT];
+static Pixel32 golden_actual[GOLDEN_WIDTH * GOLDEN_HEIGHT];
+static Pixel32 golden_diff[GOLDEN_WIDTH * GOLDEN_HEIGHT];
+// The pictures of scalar for every frame without and with -aa
+static Pixel32 golden_references[GOLDEN_FRAMES][2][GOLDEN_WIDTH * GOLDEN_HEIGHT];
+
+// The positions and the strengths of the balls are rounded to 1/16 of a pixel
+// and 1/256, which the fixed kernel represents exactly (see FIXED_POS_BITS), so
+// it is checked for its arithmetic rather than the resolution of its input.
+// The unrounded scene checks the rest.
+static size_t golden_push_ball(V2f pos, float strength, Pixel32 color)
+{
+    pos.x = roundf(pos.x * (1 << FIXED_POS_BITS)) / (1 << FIXED_POS_BITS);
+    pos.y = roundf(pos.y * (1 << FIXED_POS_BITS)) / (1 << FIXED_POS_BITS);
+    strength = roundf(strength * 256.0f) / 256.0f;
+    return scene_push_ball(&golden_scene, pos, strength, color);
+}
+
+static void golden_build(Golden_Scene which, Falloff falloff, Shading shading)
+{
+    rand_state = 0x12345678;
+    scene_clear(&golden_scene, 0x5555AA);
+    scene_set_falloff(&golden_scene, falloff);
+    scene_set_shading(&golden_scene, shading);
+    switch (which) {
+    case GOLDEN_PAIR:
+        golden_push_ball(v2f(80.0f, 90.0f), 0.3f, 0xEE22EE);
+        golden_push_ball(v2f(170.5f, 100.25f), 0.3f, 0xEEEE22);
+        break;
+    case GOLDEN_EIGHT:
+        // The most balls the unrolled kernel has a specialization for
+        for (size_t j = 0; j < 8; ++j) {
+            V2f pos = v2f(rand_float(0.0f, GOLDEN_WIDTH), rand_float(0.0f, GOLDEN_HEIGHT));
+            golden_push_ball(pos, 0.1f, rand_u32() & 0xFFFFFF);
+        }
+        break;
+    case GOLDEN_CROWD:
+        for (size_t j = 0; j < 100; ++j) {
+            V2f pos = v2f(rand_float(0.0f, GOLDEN_WIDTH), rand_float(0.0f, GOLDEN_HEIGHT));
+            size_t ball = golden_push_ball(pos, 0.01f, rand_u32() & 0xFFFFFF);
+            scene_set_radius(&golden_scene, ball, 20.0f);
+        }
+        break;
+    case GOLDEN_BORDER:
+        // Centers outside of the frame and on the edges of the pixels
+        golden_push_ball(v2f(-30.0f, 50.0f), 0.4f, 0xFF0000);
+        golden_push_ball(v2f(GOLDEN_WIDTH + 20.0f, GOLDEN_HEIGHT + 10.0f), 0.4f, 0x00FF00);
+        golden_push_ball(v2f(126.0f, 0.0f), 0.2f, 0x0000FF);
+        golden_push_ball(v2f(0.0f, GOLDEN_HEIGHT), 0.2f, 0xFFFFFF);
+        break;
+    case GOLDEN_FAINT:
+        // Every ball alone is below the threshold, so the shape is made of
+        // the sum of the weak fields and a lot of it stays close to it
+        for (size_t j = 0; j < 32; ++j) {
+            V2f pos = v2f(rand_float(0.0f, GOLDEN_WIDTH), rand_float(0.0f, GOLDEN_HEIGHT));
+            size_t ball = golden_push_ball(pos, 1.0f / 256.0f, rand_u32() & 0xFFFFFF);
+            scene_set_radius(&golden_scene, ball, 60.0f);
+        }
+        break;
+    case GOLDEN_UNROUNDED:
+        // Straight from the generator, so fixed has to round them itself
+        for (size_t j = 0; j < 24; ++j) {
+            V2f pos = v2f(rand_float(-10.0f, GOLDEN_WIDTH + 10.0f), rand_float(-10.0f, GOLDEN_HEIGHT + 10.0f));
+            size_t ball = scene_push_ball(&golden_scene, pos, rand_float(0.003f, 0.12f), rand_u32() & 0xFFFFFF);
+            scene_set_radius(&golden_scene, ball, rand_float(10.0f, 50.0f));
+        }
+        break;
+    case GOLDEN_NEGATIVE:
+        // Negative balls of the default radius taking bites out of the
+        // positive ones, a strong one outside of the frame and a cloud of
+        // faint ones below the 1/256 golden_push_ball() rounds the strengths
+        // to, which whittle the edges
+        for (size_t j = 0; j < 6; ++j) {
+            V2f pos = v2f(rand_float(0.0f, GOLDEN_WIDTH), rand_float(0.0f, GOLDEN_HEIGHT));
+            golden_push_ball(pos, rand_float(0.15f, 0.3f), rand_u32() & 0xFFFFFF);
+        }
+        for (size_t j = 0; j < 6; ++j) {
+            V2f pos = v2f(rand_float(0.0f, GOLDEN_WIDTH), rand_float(0.0f, GOLDEN_HEIGHT));
+            golden_push_ball(pos, -rand_float(0.05f, 0.2f), rand_u32() & 0xFFFFFF);
+        }
+        // Above the frame, where it lowers the field all over it, stronger
+        // than all of the positive balls together
+        golden_push_ball(v2f(GOLDEN_WIDTH / 2.0f, -400.0f), -2.0f, 0x000000);
+        for (size_t j = 0; j < 16; ++j) {
+            V2f pos = v2f(roundf(rand_float(0.0f, GOLDEN_WIDTH)), roundf(rand_float(0.0f, GOLDEN_HEIGHT)));
+            size_t ball = scene_push_ball(&golden_scene, pos, -1.0f / 1024.0f, rand_u32() & 0xFFFFFF);
+            scene_set_radius(&golden_scene, ball, 60.0f);
+        }
+        break;
+    case GOLDEN_BITE:
+        // Few enough balls for unrolled, one negative one biting into the
+        // other
+        golden_push_ball(v2f(110.0f, 90.0f), 0.5f, 0x22EEEE);
+        golden_push_ball(v2f(142.0f, 90.0f), -0.3f, 0xEE2222);
+        break;
+    default:
+        assert(0 && "unreachable");
+    }
+
+    // Half of the balls for the static cache of the renderer, never the first
+    // one, which the second frame moves
+    for (size_t i = 1; i < golden_scene.count; i += 2) {
+        scene_set_static(&golden_scene, i, true);
+    }
+    golden_first = v2f(golden_scene.xs[0], golden_scene.ys[0]);
+}
+
+// Puts the first ball where it is in the frame, moving by whole pixels so it
+// stays where fixed represents it exactly
+static void golden_move(size_t frame)
+{
+    scene_move_ball(&golden_scene, 0, v2f_sum(golden_first, v2f(5.0f * frame, -3.0f * frame)));
+}
+
+// The most a channel may differ from scalar. The palette shading may pick the
+// neighbouring entry of the palette, see README.md.
+static int golden_tolerance(const Scene *scene)
+{
+    int tolerance = GOLDEN_TOLERANCE;
+    if (scene->shading != SHADING_PALETTE) return tolerance;
+    for (size_t k = 0; k + 1 < PALETTE_SIZE; ++k) {
+        for (int c = 0; c < 3; ++c) {
+            int a = (scene->palette[k] >> (8 * c)) & 0xFF;
+            int b = (scene->palette[k + 1] >> (8 * c)) & 0xFF;
+            int d = a > b ? a - b : b - a;
+            if (d > tolerance) tolerance = d;
+        }
+    }
+    return tolerance;
+}
+
+// How close to the threshold the field has to be for a pixel to flip
+static double golden_flip_margin(const Scene *scene, const Kernel *kernel)
+{
+    if (kernel->render == render_region_lut && scene->falloff == FALLOFF_INVERSE4) {
+        return GOLDEN_LUT_INVERSE4_FLIP_MARGIN;
+    }
+    return GOLDEN_FLIP_MARGIN;
+}
+
+// The field at the point in double precision
+static double golden_field_at(const Scene *scene, double px, double py)
+{
+    double s = 0.0;
+    for (size_t i = 0; i < scene->count; ++i) {
+        double dx = scene->xs[i] - px;
+        double dy = scene->ys[i] - py;
+        s += scene->strengths[i] * falloff_reference(scene->falloff, dx*dx + dy*dy, scene->inv_radii2[i]);
+    }
+    return s;
+}
+
+// The field at the center of the pixel in double precision
+static double golden_field(const Scene *scene, size_t x, size_t y)
+{
+    return golden_field_at(scene, (double) x + 0.5, (double) y + 0.5);
+}
+
+// How many times the sum of the absolute fields of the balls at the center of
+// the pixel is larger than their sum. The kernels round every ball, so their
+// error grows with the former, while the margins and the tolerances are made
+// for the latter. It's 1 without negative balls around and grows where they
+// cancel the positive ones.
+static double golden_condition(const Scene *scene, size_t x, size_t y)
+{
+    double s = 0.0, magnitude = 0.0;
+    for (size_t i = 0; i < scene->count; ++i) {
+        double dx = scene->xs[i] - ((double) x + 0.5);
+        double dy = scene->ys[i] - ((double) y + 0.5);
+        double si = scene->strengths[i] * falloff_reference(scene->falloff, dx*dx + dy*dy, scene->inv_radii2[i]);
+        s += si;
+        magnitude += fabs(si);
+    }
+    return magnitude > fabs(s) ? magnitude / fabs(s) : 1.0;
+}
+
+// Whether every channel of the colors differs by at most tolerance in the
+// space the shading blends the colors in, which is linear light for
+// SHADING_LINEAR. Close to black its sRGB steps are much finer than the ones
+// of the linear light.
+static bool golden_close(const Scene *scene, Pixel32 e, Pixel32 a, double tolerance)
+{
+    for (int c = 0; c < 3; ++c) {
+        int ec = (e >> (8 * c)) & 0xFF, ac = (a >> (8 * c)) & 0xFF;
+        double d = scene->shading == SHADING_LINEAR
+            ? 255.0 * fabs((double) srgb_to_linear_lut[ec] - (double) srgb_to_linear_lut[ac])
+            : fabs((double) ec - (double) ac);
+        if (d > tolerance) return false;
+    }
+    return true;
+}
+
+// Whether the contour crosses the pixel, that is its corners and its center
+// are not all on the same side of the threshold. Which of such pixels aa.c
+// supersamples depends on the flips of their neighbours, so two renderers
+// with -aa may legitimately disagree on them.
+static bool golden_crossed(const Scene *scene, size_t x, size_t y)
+{
+    static const double points[][2] = {{0.0, 0.0}, {1.0, 0.0}, {0.0, 1.0}, {1.0, 1.0}, {0.5, 0.5}};
+    bool inside = golden_field_at(scene, (double) x + points[0][0], (double) y + points[0][1]) >= FIELD_THRESHOLD;
+    for (size_t i = 1; i < sizeof(points)/sizeof(points[0]); ++i) {
+        double s = golden_field_at(scene, (double) x + points[i][0], (double) y + points[i][1]);
+        if ((s >= FIELD_THRESHOLD) != inside) return true;
+    }
+    return false;
+}
+
+// Whether the center of a ball of a 1/r falloff is within the pixel. The field
+// goes to infinity there, so no two kernels have to agree on the pixel and
+// even scalar may end up with a NaN.
+static bool golden_singular(const Scene *scene, size_t x, size_t y)
+{
+    if (falloff_is_compact(scene->falloff)) return false;
+    for (size_t i = 0; i < scene->count; ++i) {
+        if (scene->xs[i] >= (float) x && scene->xs[i] <= (float) (x + 1) &&
+            scene->ys[i] >= (float) y && scene->ys[i] <= (float) (y + 1)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+typedef struct {
+    int max_diff;
+    size_t mismatches;
+    size_t flips;
+    // Flips farther than the margin of golden_flip_margin() from the threshold
+    size_t far_flips;
+    // Differences of any size on the pixels crossed by the contour with -aa
+    size_t edges;
+} Golden_Result;
+
+// Compares golden_actual against golden_expected and paints golden_diff:
+// the expected picture darkened where they are the same, gray where they
+// differ within the tolerance, red where they differ more, yellow for the
+// flips close to the threshold, magenta for the rest of them, cyan for the
+// differences on the pixels crossed by the contour if the pictures are
+// antialiased and blue for the singular pixels, which are not compared
+static Golden_Result golden_compare(const Scene *scene, int tolerance, double margin, bool aa)
+{
+    Golden_Result result = {0};
+    for (size_t y = 0; y < GOLDEN_HEIGHT; ++y) {
+        for (size_t x = 0; x < GOLDEN_WIDTH; ++x) {
+            size_t i = y*GOLDEN_WIDTH + x;
+            Pixel32 e = golden_expected[i], a = golden_actual[i];
+            if (e == a) {
+                golden_diff[i] = (e >> 2) & 0x3F3F3F;
+                continue;
+            }
+            if (golden_singular(scene, x, y)) {
+                golden_diff[i] = 0x0000FF;
+                continue;
+            }
+            if (aa && golden_crossed(scene, x, y)) {
+                result.edges += 1;
+                golden_diff[i] = 0x00FFFF;
+                continue;
+            }
+
+            if ((e == scene->background) != (a == scene->background)) {
+                result.flips += 1;
+                double s = golden_field(scene, x, y);
+                double near = margin * FIELD_THRESHOLD * golden_condition(scene, x, y);
+                if (fabs(s - FIELD_THRESHOLD) <= near) {
+                    golden_diff[i] = 0xFFFF00;
+                } else {
+                    result.far_flips += 1;
+                    golden_diff[i] = 0xFF00FF;
+                }
+                continue;
+            }
+
+            int diff = 0;
+            for (int c = 0; c < 3; ++c) {
+                int ec = (e >> (8 * c)) & 0xFF, ac = (a >> (8 * c)) & 0xFF;
+                int d = ec > ac ? ec - ac : ac - ec;
+                if (d > diff) diff = d;
+            }
+            if (diff > result.max_diff) result.max_diff = diff;
+            // Only the negative balls widen the tolerance
+            double condition = diff > tolerance ? golden_condition(scene, x, y) : 1.0;
+            if (diff > tolerance && !(condition > 1.0 && golden_close(scene, e, a, tolerance * condition))) {
+                result.mismatches += 1;
+                golden_diff[i] = 0xFF0000;
+            } else {
+                golden_diff[i] = 0x808080;
+            }
+        }
+    }
+    return result;
+}
+
+static bool golden_save_ppm(const Pixel32 *pixels, size_t width, size_t height, const char *path)
+{
+    FILE *f = fopen(path, "wb");
+    if (f == NULL) {
+        fprintf(stderr, "ERROR: could not open file %s: %s\n", path, strerror(errno));
+        return false;
+    }
+    fprintf(f, "P6\n%zu %zu\n255\n", width, height);
+    for (size_t i = 0; i < width * height; ++i) {
+        uint8_t rgb[3] = {
+            (pixels[i] >> (8 * 2)) & 0xFF,
+            (pixels[i] >> (8 * 1)) & 0xFF,
+            (pixels[i] >> (8 * 0)) & 0xFF,
+        };
+        fwrite(rgb, sizeof(rgb), 1, f);
+    }
+    bool ok = !ferror(f);
+    if (!ok) fprintf(stderr, "ERROR: could not write to file %s: %s\n", path, strerror(errno));
+    fclose(f);
+    return ok;
+}
+
+typedef struct {
+    size_t cases, failed, mismatches, flips;
+    int max_diff;
+} Golden_Stats;
+
+static void golden_print_stats(const char *name, const Golden_Stats *stats)
+{
+    printf("%-10s %8zu %8d %10zu %10zu %8zu\n", name, stats->cases, stats->max_diff,
+           stats->mismatches, stats->flips, stats->failed);
+}
+
+// Compares golden_actual rendered by the kernel, antialiased if aa, against
+// golden_expected and adds the outcome to stats. A failed comparison is
+// reported as what and leaves the pictures of both and their diff (see
+// golden_compare()) in dir, named after name.
+static void golden_check(const char *dir, const char *what, const char *name,
+                         const Kernel *kernel, bool aa, Golden_Stats *stats)
+{
+    Golden_Result result = golden_compare(&golden_scene, golden_tolerance(&golden_scene),
+                                          golden_flip_margin(&golden_scene, kernel), aa);
+    stats->cases += 1;
+    stats->mismatches += result.mismatches;
+    stats->flips += result.flips;
+    if (result.max_diff > stats->max_diff) stats->max_diff = result.max_diff;
+    if (result.mismatches == 0 && result.far_flips == 0 && result.flips <= GOLDEN_MAX_FLIPS &&
+        result.edges <= GOLDEN_MAX_FLIPS) {
+        return;
+    }
+
+    stats->failed += 1;
+    fprintf(stderr, "FAILED: %s: max diff %d, %zu mismatches, %zu flips (%zu far from the threshold), "
+            "%zu edges\n", what, result.max_diff, result.mismatches, result.flips, result.far_flips,
+            result.edges);
+
+    char path[512];
+    snprintf(path, sizeof(path), "%s/golden-%s-expected.ppm", dir, name);
+    golden_save_ppm(golden_expected, GOLDEN_WIDTH, GOLDEN_HEIGHT, path);
+    snprintf(path, sizeof(path), "%s/golden-%s-actual.ppm", dir, name);
+    golden_save_ppm(golden_actual, GOLDEN_WIDTH, GOLDEN_HEIGHT, path);
+    snprintf(path, sizeof(path), "%s/golden-%s-diff.ppm", dir, name);
+    if (golden_save_ppm(golden_diff, GOLDEN_WIDTH, GOLDEN_HEIGHT, path)) {
+        fprintf(stderr, "INFO: saved the diff to %s\n", path);
+    }
+}
+
+// Renders every scene of the library with every falloff and shading by the
+// kernel alone and compares the picture against the one of the scalar kernel
+static void golden_kernel(const char *dir, const Kernel *kernel, Golden_Stats *stats)
+{
+    for (Golden_Scene which = 0; which < COUNT_GOLDEN_SCENES; ++which) {
+        for (Falloff falloff = 0; falloff < COUNT_FALLOFFS; ++falloff) {
+            for (Shading shading = 0; shading < COUNT_SHADINGS; ++shading) {
+                golden_build(which, falloff, shading);
+                // The kernel would just fall back to scalar
+                if (kernel_for_scene(kernel, &golden_scene) != kernel) continue;
+
+                render_scene(golden_expected, GOLDEN_WIDTH, GOLDEN_HEIGHT, &golden_scene, &kernels[0]);
+                render_scene(golden_actual, GOLDEN_WIDTH, GOLDEN_HEIGHT, &golden_scene, kernel);
+
+                char what[256], name[256];
+                snprintf(what, sizeof(what), "%s scene with %s falloff and %s shading by %s",
+                         golden_scene_names[which], falloff_names[falloff], shading_names[shading],
+                         kernel->name);
+                snprintf(name, sizeof(name), "%s-%s-%s-%s", golden_scene_names[which],
+                         falloff_names[falloff], shading_names[shading], kernel->name);
+                golden_check(dir, what, name, kernel, false, stats);
+            }
+        }
+    }
+}
+
+// Same as golden_kernel() but through the whole renderer with the kernel, the
+// tiles on the threads of the pool and every combination of its options, for
+// every frame of golden_move(). The pictures with -aa are compared against the
+// renderer with scalar, -aa and every other option off.
+static void golden_renderer(const char *dir, const Kernel *kernel, Pool *pool, Golden_Stats *stats)
+{
+    Renderer renderer = {0};
+    renderer_init(&renderer, kernel, pool);
+    Renderer reference = {0};
+    renderer_init(&reference, &kernels[0], pool);
+    reference.use_spans = false;
+    reference.use_quadtree = false;
+    reference.use_bins = false;
+    reference.use_static_cache = false;
+    reference.use_aa = true;
+
+    for (Golden_Scene which = 0; which < COUNT_GOLDEN_SCENES; ++which) {
+        for (Falloff falloff = 0; falloff < COUNT_FALLOFFS; ++falloff) {
+            for (Shading shading = 0; shading < COUNT_SHADINGS; ++shading) {
+                golden_build(which, falloff, shading);
+                // Scalar goes through the renderer either way
+                if (kernel != &kernels[0] && kernel_for_scene(kernel, &golden_scene) != kernel) continue;
+
+                for (size_t frame = 0; frame < GOLDEN_FRAMES; ++frame) {
+                    golden_move(frame);
+                    render_scene(golden_references[frame][0], GOLDEN_WIDTH, GOLDEN_HEIGHT,
+                                 &golden_scene, &kernels[0]);
+                    renderer_render(&reference, golden_references[frame][1], GOLDEN_WIDTH, GOLDEN_HEIGHT,
+                                    &golden_scene);
+                }
+
+                for (unsigned int options = 0; options < (1u << GOLDEN_OPTIONS); ++options) {
+                    renderer.use_spans = !(options & (1u << 0));
+                    renderer.use_quadtree = !(options & (1u << 1));
+                    renderer.use_bins = !(options & (1u << 2));
+                    renderer.use_static_cache = !(options & (1u << 3));
+                    renderer.use_aa = options & GOLDEN_AA;
+
+                    char flags[128] = "", flags_name[128] = "";
+                    for (size_t i = 0; i < GOLDEN_OPTIONS; ++i) {
+                        if (!(options & (1u << i))) continue;
+                        size_t n = strlen(flags);
+                        snprintf(flags + n, sizeof(flags) - n, " %s", golden_option_flags[i]);
+                        n = strlen(flags_name);
+                        snprintf(flags_name + n, sizeof(flags_name) - n, "%s", golden_option_flags[i]);
+                    }
+
+                    for (size_t frame = 0; frame < GOLDEN_FRAMES; ++frame) {
+                        golden_move(frame);
+                        renderer_render(&renderer, golden_actual, GOLDEN_WIDTH, GOLDEN_HEIGHT, &golden_scene);
+                        memcpy(golden_expected, golden_references[frame][(options & GOLDEN_AA) != 0],
+                               sizeof(golden_expected));
+
+                        char what[512], name[256];
+                        snprintf(what, sizeof(what), "%s scene with %s falloff and %s shading by %s "
+                                 "in the renderer with%s, frame %zu",
+                                 golden_scene_names[which], falloff_names[falloff], shading_names[shading],
+                                 kernel->name, options ? flags : " every option", frame);
+                        snprintf(name, sizeof(name), "%s-%s-%s-%s-renderer%s-%zu", golden_scene_names[which],
+                                 falloff_names[falloff], shading_names[shading], kernel->name, flags_name,
+                                 frame);
+                        golden_check(dir, what, name, kernel, renderer.use_aa, stats);
+                    }
+                }
+            }
+        }
+    }
+
+    renderer_free(&renderer);
+    renderer_free(&reference);
+}
+
+// Compares every kernel that implements them against scalar on every scene of
+// the library with every falloff and shading alone, and the kernels with the
+// given names, or scalar and kernel_best() if there are none, through the
+// renderer. Every failed comparison leaves the pictures in dir. Returns the
+// amount of the failed comparisons.
+static size_t bench_golden(const char *dir, int argc, char **argv)
+{
+    uint32_t renderer_mask = 0;
+    for (int i = 0; i < argc; ++i) {
+        const Kernel *kernel = kernel_by_name(argv[i]);
+        if (kernel == NULL) {
+            fprintf(stderr, "ERROR: unknown kernel %s\n", argv[i]);
+            exit(1);
+        }
+        renderer_mask |= 1u << (kernel - kernels);
+    }
+    if (renderer_mask == 0) renderer_mask = 1u | (1u << (kernel_best() - kernels));
+
+    size_t failed = 0;
+
+    printf("%-10s %8s %8s %10s %10s %8s\n", "kernel", "cases", "max diff", "mismatches", "flips", "failed");
+    for (size_t k = 1; k < KERNELS_COUNT; ++k) {
+        const Kernel *kernel = &kernels[k];
+        if (!kernel_supported(kernel)) continue;
+        Golden_Stats stats = {0};
+        golden_kernel(dir, kernel, &stats);
+        golden_print_stats(kernel->name, &stats);
+        failed += stats.failed;
+    }
+
+    Pool pool;
+    pool_init(&pool, GOLDEN_THREADS);
+    printf("\n%-10s %8s %8s %10s %10s %8s\n", "renderer", "cases", "max diff", "mismatches", "flips", "failed");
+    for (size_t k = 0; k < KERNELS_COUNT; ++k) {
+        const Kernel *kernel = &kernels[k];
+        if (!(renderer_mask & (1u << k)) || !kernel_supported(kernel)) continue;
+        Golden_Stats stats = {0};
+        golden_renderer(dir, kernel, &pool, &stats);
+        golden_print_stats(kernel->name, &stats);
+        failed += stats.failed;
+    }
+    pool_destroy(&pool);
+
+    return failed;
+}
+
+static void usage(FILE *stream, const char *program)
+{
+    fprintf(stream, "Usage: %s <benchmark> [ARGS]\n", program);
+    fprintf(stream, "BENCHMARKS:\n");
+    fprintf(stream, "    falloff    cost and accuracy of every implementation of every falloff\n");
+    fprintf(stream, "    kernels    cost of every kernel on a single thread from 1 to 1024 balls\n");
+    fprintf(stream, "    shading    cost of every shading over the blend one\n");
+    fprintf(stream, "    bins       length of the per-tile ball lists and frame time from 10 to 10000 balls\n");
+    fprintf(stream, "    contour    cost of the extraction of the contour against the raster at 1600x900\n");
+    fprintf(stream, "    scenes     frame times of the whole renderer from 640x360 to 7680x4320 as CSV,\n");
+    fprintf(stream, "               for the kernels and the falloffs given in ARGS or all of them\n");
+    fprintf(stream, "    golden     compare the pictures of every kernel alone and of the renderer against\n");
+    fprintf(stream, "               scalar, saving the diffs of the failed ones to the directory in ARGS\n");
+    fprintf(stream, "               (default: .), followed by the kernels for the renderer (default:\n");
+    fprintf(stream, "               scalar and the fastest one)\n");
+}
+
+int main(int argc, char **argv)
+{
+    const char *program = argv[0];
+    if (argc < 2) {
+        usage(stderr, program);
+        fprintf(stderr, "ERROR: no benchmark is provided\n");
+        return 1;
+    }
+
+    const char *name = argv[1];
+    if (strcmp(name, "falloff") == 0) {
+        bench_falloffs();
+    } else if (strcmp(name, "kernels") == 0) {
+        bench_kernels();
+    } else if (strcmp(name, "shading") == 0) {
+        bench_shadings();
+    } else if (strcmp(name, "bins") == 0) {
+        bench_bins();
+    } else if (strcmp(name, "contour") == 0) {
+        bench_contour();
+    } else if (strcmp(name, "scenes") == 0) {
+        bench_scenes(argc - 2, argv + 2);
+    } else if (strcmp(name, "golden") == 0) {
+        size_t failed = bench_golden(argc > 2 ? argv[2] : ".", argc > 3 ? argc - 3 : 0, argv + 3);
+        if (failed > 0) {
+            fprintf(stderr, "ERROR: %zu comparisons failed\n", failed);
+            return 1;
+        }
+    } else {
+        usage(stderr, program);
+        fprintf(stderr, "ERROR: unknown benchmark %s\n", name);
+        return 1;
+    }
+
+    return 0;
+}
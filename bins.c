@@ -0,0 +1,160 @@
+// Per-tile lists of the balls that can reach the tile, so the kernel of a tile
+// iterates only over its own balls instead of all of them.
+//
+// A ball reaches the pixels within ball_influence_radius(scene, i, 0.0f) of
+// its center. For the compact falloffs that's exactly the radius of the ball,
+// so leaving it out of the tiles beyond that doesn't change the picture. The
+// inverse falloff never reaches zero and every ball would end up in every
+// tile, so there is nothing to gain from the binning for it.
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+typedef struct {
+    size_t width, height;
+    size_t tiles;
+    // The balls of the tile i are items[offsets[i]..offsets[i + 1]), in the
+    // same order as in the scene
+    uint32_t *offsets;
+    // Scratch space of bins_build()
+    uint32_t *cursors;
+    uint32_t *items;
+    size_t items_cap;
+    // The longest list of the last frame
+    size_t longest;
+} Bins;
+
+static inline float bins_ball_radius(const Scene *scene, size_t i)
+{
+    // The balls of negative strength reach as far as the positive ones, but
+    // 0.0f/strength is -0.0f for them, so don't trust the sign. An extra pixel
+    // so a ball is never left out of a tile where the rounding of the kernels
+    // still gives it a tiny bit of field.
+    return fabsf(ball_influence_radius(scene, i, 0.0f)) + 1.0f;
+}
+
+// The range of the tiles [tx0, tx1)x[ty0, ty1) covered by the bounding box of
+// the ball i. Returns false if the ball can't reach any tile at all.
+static bool bins_ball_range(const Bins *bins, const Scene *scene, size_t i, float radius,
+                            size_t *tx0, size_t *ty0, size_t *tx1, size_t *ty1)
+{
+    // Balls of zero strength contribute nothing anywhere
+    if (scene->strengths[i] == 0.0f) return false;
+
+    size_t tiles_x = (bins->width + TILE_SIZE - 1) / TILE_SIZE;
+    size_t tiles_y = (bins->height + TILE_SIZE - 1) / TILE_SIZE;
+    float lx = floorf((scene->xs[i] - radius - 0.5f) / TILE_SIZE);
+    float hx = floorf((scene->xs[i] + radius - 0.5f) / TILE_SIZE);
+    float ly = floorf((scene->ys[i] - radius - 0.5f) / TILE_SIZE);
+    float hy = floorf((scene->ys[i] + radius - 0.5f) / TILE_SIZE);
+    if (hx < 0.0f || hy < 0.0f || lx >= (float) tiles_x || ly >= (float) tiles_y) return false;
+
+    *tx0 = lx < 0.0f ? 0 : (size_t) lx;
+    *ty0 = ly < 0.0f ? 0 : (size_t) ly;
+    *tx1 = hx >= (float) tiles_x ? tiles_x : (size_t) hx + 1;
+    *ty1 = hy >= (float) tiles_y ? tiles_y : (size_t) hy + 1;
+    return true;
+}
+
+// Whether any pixel center of the tile is closer than radius to the ball
+static inline bool ball_reaches_tile(const Scene *scene, size_t i, float radius, size_t tx, size_t ty)
+{
+    float left = (float) (tx * TILE_SIZE) + 0.5f;
+    float top = (float) (ty * TILE_SIZE) + 0.5f;
+    float right = left + (TILE_SIZE - 1);
+    float bottom = top + (TILE_SIZE - 1);
+    float x = scene->xs[i], y = scene->ys[i];
+    float dx = x < left ? left - x : x > right ? x - right : 0.0f;
+    float dy = y < top ? top - y : y > bottom ? y - bottom : 0.0f;
+    return dx*dx + dy*dy < radius*radius;
+}
+
+void bins_build(Bins *bins, size_t width, size_t height, const Scene *scene)
+{
+    size_t tiles = tiles_count(width, height);
+    if (bins->tiles != tiles || bins->offsets == NULL) {
+        free(bins->offsets);
+        free(bins->cursors);
+        bins->offsets = malloc((tiles + 1) * sizeof(*bins->offsets));
+        bins->cursors = malloc(tiles * sizeof(*bins->cursors));
+        if (bins->offsets == NULL || bins->cursors == NULL) {
+            fprintf(stderr, "ERROR: could not allocate memory for the bins: %s\n",
+                    strerror(errno));
+            exit(1);
+        }
+        bins->tiles = tiles;
+    }
+    bins->width = width;
+    bins->height = height;
+
+    size_t tiles_x = (width + TILE_SIZE - 1) / TILE_SIZE;
+
+    // Counting sort of the (tile, ball) pairs by the tile
+    memset(bins->cursors, 0, tiles * sizeof(*bins->cursors));
+    for (size_t i = 0; i < scene->count; ++i) {
+        size_t tx0, ty0, tx1, ty1;
+        float radius = bins_ball_radius(scene, i);
+        if (!bins_ball_range(bins, scene, i, radius, &tx0, &ty0, &tx1, &ty1)) continue;
+        for (size_t ty = ty0; ty < ty1; ++ty) {
+            for (size_t tx = tx0; tx < tx1; ++tx) {
+                if (ball_reaches_tile(scene, i, radius, tx, ty)) {
+                    bins->cursors[ty * tiles_x + tx] += 1;
+                }
+            }
+        }
+    }
+
+    size_t total = 0;
+    bins->longest = 0;
+    for (size_t index = 0; index < tiles; ++index) {
+        size_t count = bins->cursors[index];
+        if (count > bins->longest) bins->longest = count;
+        bins->offsets[index] = (uint32_t) total;
+        bins->cursors[index] = (uint32_t) total;
+        total += count;
+    }
+    bins->offsets[tiles] = (uint32_t) total;
+
+    if (total > bins->items_cap) {
+        free(bins->items);
+        bins->items_cap = total * 2;
+        bins->items = malloc(bins->items_cap * sizeof(*bins->items));
+        if (bins->items == NULL) {
+            fprintf(stderr, "ERROR: could not allocate memory for the bins: %s\n",
+                    strerror(errno));
+            exit(1);
+        }
+    }
+
+    // The balls are visited in order, so every list is in the order of the
+    // scene and the kernels sum up the field in the same order as without the
+    // bins
+    for (size_t i = 0; i < scene->count; ++i) {
+        size_t tx0, ty0, tx1, ty1;
+        float radius = bins_ball_radius(scene, i);
+        if (!bins_ball_range(bins, scene, i, radius, &tx0, &ty0, &tx1, &ty1)) continue;
+        for (size_t ty = ty0; ty < ty1; ++ty) {
+            for (size_t tx = tx0; tx < tx1; ++tx) {
+                if (ball_reaches_tile(scene, i, radius, tx, ty)) {
+                    size_t index = ty * tiles_x + tx;
+                    bins->items[bins->cursors[index]++] = (uint32_t) i;
+                }
+            }
+        }
+    }
+}
+
+// Average length of the lists of the last frame
+float bins_average(const Bins *bins)
+{
+    if (bins->tiles == 0) return 0.0f;
+    return (float) bins->offsets[bins->tiles] / (float) bins->tiles;
+}
+
+void bins_free(Bins *bins)
+{
+    free(bins->offsets);
+    free(bins->cursors);
+    free(bins->items);
+    *bins = (Bins) {0};
+}
@@ -6,6 +6,9 @@ where /q cl || (
   exit /b 1
 )
 
+call cl /O2 /Fe:lutgen /nologo /W3 lutgen.c || exit /b 1
+lutgen.exe > falloff_lut.h || exit /b 1
+
 call cl /O2 /Fe:metaballs /nologo /W3 main.c /link User32.lib Gdi32.lib /subsystem:windows
 
 dir metaballs.exe
@@ -0,0 +1,94 @@
+// Caching of the field of the static balls across frames. The field of all the
+// balls marked with scene_set_static() is accumulated once into a per-pixel
+// float buffer and every frame only the moving balls are evaluated on top of
+// it. The buffer is rebuilt whenever scene->statics_version changes.
+#include <stdlib.h>
+
+typedef struct {
+    // The scene and its statics_version the field was built for
+    const Scene *scene;
+    size_t version;
+    size_t width, height;
+    Field field;
+    // The moving balls of the scene, refreshed every frame
+    Scene dynamic;
+} Static_Cache;
+
+typedef struct {
+    const Scene *scene;
+    const Field *field;
+    size_t width, height;
+} Static_Field_Job;
+
+static void accumulate_static_tile(void *arg, size_t index)
+{
+    const Static_Field_Job *job = arg;
+    size_t x0, y0, x1, y1;
+    tile_rect(index, job->width, job->height, &x0, &y0, &x1, &y1);
+    accumulate_field(job->scene, true, job->field, job->width, x0, y0, x1, y1);
+}
+
+static void static_cache_rebuild(Static_Cache *cache, Pool *pool,
+                                 size_t width, size_t height, const Scene *scene)
+{
+    if (cache->width != width || cache->height != height || cache->field.s == NULL) {
+        free(cache->field.s);
+        // The planes of the gradient are filled only for SHADING_LIT
+        float *planes = malloc(6 * width * height * sizeof(float));
+        if (planes == NULL) {
+            fprintf(stderr, "ERROR: could not allocate memory for the static field cache: %s\n",
+                    strerror(errno));
+            exit(1);
+        }
+        cache->field.s = planes;
+        cache->field.r = planes + 1 * width * height;
+        cache->field.g = planes + 2 * width * height;
+        cache->field.b = planes + 3 * width * height;
+        cache->field.gx = planes + 4 * width * height;
+        cache->field.gy = planes + 5 * width * height;
+        cache->width = width;
+        cache->height = height;
+    }
+
+    Static_Field_Job job = {
+        .scene = scene,
+        .field = &cache->field,
+        .width = width,
+        .height = height,
+    };
+    pool_run(pool, tiles_count(width, height), accumulate_static_tile, &job);
+
+    cache->scene = scene;
+    cache->version = scene->statics_version;
+}
+
+void static_cache_free(Static_Cache *cache)
+{
+    free(cache->field.s);
+    cache->field = (Field) {0};
+    cache->scene = NULL;
+    scene_free(&cache->dynamic);
+}
+
+// Brings the cache up to date with the scene and returns the field of its
+// static balls, or NULL if there are none. cache->dynamic then holds the
+// balls that have to be evaluated on top of the field.
+const Field *static_cache_update(Static_Cache *cache, Pool *pool,
+                                 size_t width, size_t height, const Scene *scene)
+{
+    bool has_statics = false;
+    for (size_t i = 0; i < scene->count && !has_statics; ++i) {
+        has_statics = scene->statics[i];
+    }
+    if (!has_statics) return NULL;
+
+    if (cache->scene != scene || cache->version != scene->statics_version ||
+        cache->width != width || cache->height != height || cache->field.s == NULL) {
+        begin_clock("STATIC CACHE");
+        static_cache_rebuild(cache, pool, width, height, scene);
+        end_clock();
+    }
+
+    scene_copy_dynamic(scene, &cache->dynamic);
+    return &cache->field;
+}
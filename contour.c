@@ -0,0 +1,324 @@
+// Extraction of the iso-contour of the field at FIELD_THRESHOLD as closed
+// polylines, by marching squares over a grid of samples every cell pixels.
+//
+// The samples of the field are taken at the corners of the cells, with a ring
+// of samples around the frame fixed at zero, so every contour closes even if
+// its balls go past the border of the frame. Every cell crossed by the contour
+// emits one or two segments between the edges it crosses, oriented so the
+// inside of the contour is always on the same side. That way every crossed
+// edge has exactly one segment leaving it, and the segments are stitched into
+// polylines by following them from edge to edge. The point on an edge is
+// interpolated linearly between the samples of its ends, and both cells
+// sharing the edge get the same one.
+//
+// Only the values of the samples next to the contour matter, the rest only
+// need to be on the right side of the threshold. So the samples are taken in
+// blocks of CONTOUR_BLOCK x CONTOUR_BLOCK, and the blocks where the bounds of
+// the field (see field_bounds_rect()) over the block and its neighbouring
+// samples stay on one side of the threshold are filled without evaluating the
+// field.
+//
+// Both the sampling and the cells are split across the pool by grid rows.
+#include <stdint.h>
+#include <stdlib.h>
+
+#define CONTOUR_NONE UINT32_MAX
+#define CONTOUR_BLOCK 16
+
+typedef struct {
+    size_t width, height, cell;
+    // Amount of the samples along x and y, including the ring of zeros
+    size_t nx, ny;
+    float *samples;
+    // For every edge of the grid the edge the contour continues to, or
+    // CONTOUR_NONE. The horizontal edge to the right of the sample (i, j) is
+    // j*nx + i, the vertical one below it nx*ny + j*nx + i.
+    uint32_t *next;
+    // The polyline i is points[starts[i]..starts[i + 1]) and its last point
+    // connects back to the first one
+    V2f *points;
+    size_t points_count, points_cap;
+    uint32_t *starts;
+    size_t count, starts_cap;
+} Contour;
+
+typedef struct {
+    Contour *contour;
+    const Scene *scene;
+} Contour_Job;
+
+// Position of the sample (i, j) in the frame. The ring of zeros sits one cell
+// outside of the frame.
+static inline V2f contour_sample_pos(const Contour *contour, size_t i, size_t j)
+{
+    return v2f((float) ((int) i - 1) * (float) contour->cell,
+               (float) ((int) j - 1) * (float) contour->cell);
+}
+
+static ALWAYS_INLINE void contour_sample_block_with(const Contour_Job *job,
+                                                   size_t i0, size_t j0, size_t i1, size_t j1,
+                                                   Falloff_Func f)
+{
+    Contour *contour = job->contour;
+    const Scene *scene = job->scene;
+    for (size_t j = j0; j < j1; ++j) {
+        float py = contour_sample_pos(contour, 0, j).y;
+        for (size_t i = i0; i < i1; ++i) {
+            float px = contour_sample_pos(contour, i, 0).x;
+            float s = 0.0f;
+            for (size_t k = 0; k < scene->count; ++k) {
+                float dx = scene->xs[k] - px;
+                float dy = scene->ys[k] - py;
+                s += scene->strengths[k] * f(dx*dx + dy*dy, scene->inv_radii2[k]);
+            }
+            contour->samples[j*contour->nx + i] = s;
+        }
+    }
+}
+
+static void contour_sample_block(const Contour_Job *job, size_t i0, size_t j0, size_t i1, size_t j1)
+{
+    switch (job->scene->falloff) {
+    case FALLOFF_INVERSE:
+        contour_sample_block_with(job, i0, j0, i1, j1, falloff_inverse);
+        break;
+    case FALLOFF_INVERSE_Q2:
+        contour_sample_block_with(job, i0, j0, i1, j1, falloff_inverse_q2);
+        break;
+    case FALLOFF_INVERSE_SQRTF:
+        contour_sample_block_with(job, i0, j0, i1, j1, falloff_inverse_sqrtf);
+        break;
+    case FALLOFF_INVERSE4:
+        contour_sample_block_with(job, i0, j0, i1, j1, falloff_inverse4);
+        break;
+    case FALLOFF_WYVILL:
+        contour_sample_block_with(job, i0, j0, i1, j1, falloff_wyvill);
+        break;
+    case FALLOFF_MURAKAMI:
+        contour_sample_block_with(job, i0, j0, i1, j1, falloff_murakami);
+        break;
+    default:
+        assert(0 && "unreachable");
+    }
+}
+
+static void contour_fill_block(Contour *contour, size_t i0, size_t j0, size_t i1, size_t j1, float s)
+{
+    for (size_t j = j0; j < j1; ++j) {
+        for (size_t i = i0; i < i1; ++i) {
+            contour->samples[j*contour->nx + i] = s;
+        }
+    }
+}
+
+// Samples the rows [band*CONTOUR_BLOCK, (band + 1)*CONTOUR_BLOCK) of the grid
+// without the ring of zeros
+static void contour_sample_band(void *arg, size_t band)
+{
+    const Contour_Job *job = arg;
+    Contour *contour = job->contour;
+    size_t nx = contour->nx, ny = contour->ny;
+    size_t j0 = 1 + band*CONTOUR_BLOCK;
+    size_t j1 = j0 + CONTOUR_BLOCK < ny - 1 ? j0 + CONTOUR_BLOCK : ny - 1;
+    for (size_t i0 = 1; i0 < nx - 1; i0 += CONTOUR_BLOCK) {
+        size_t i1 = i0 + CONTOUR_BLOCK < nx - 1 ? i0 + CONTOUR_BLOCK : nx - 1;
+        // With the neighbouring samples, so no edge leaving the block can be
+        // crossed by the contour either
+        V2f lo = contour_sample_pos(contour, i0 - 1, j0 - 1);
+        V2f hi = contour_sample_pos(contour, i1, j1);
+        Field_Bounds bounds = field_bounds_rect(job->scene, lo.x, lo.y, hi.x, hi.y);
+        if (bounds.hi < FIELD_THRESHOLD) {
+            contour_fill_block(contour, i0, j0, i1, j1, 0.0f);
+        } else if (bounds.lo >= FIELD_THRESHOLD && i0 > 1 && j0 > 1 && i1 < nx - 1 && j1 < ny - 1) {
+            // Unless the neighbours include the ring of zeros
+            contour_fill_block(contour, i0, j0, i1, j1, bounds.lo);
+        } else {
+            contour_sample_block(job, i0, j0, i1, j1);
+        }
+    }
+}
+
+// Links the edges crossed by the contour in the row of cells j. The corners of
+// a cell go clockwise from the top left one and the edge k of the cell is the
+// one between the corners k and k + 1. Every edge going from outside to inside
+// is linked to the next one clockwise going back outside, which keeps the
+// inside on the same side of every segment.
+static void contour_cells_row(void *arg, size_t j)
+{
+    Contour *contour = ((const Contour_Job *) arg)->contour;
+    size_t nx = contour->nx, ny = contour->ny;
+    for (size_t i = 0; i + 1 < nx; ++i) {
+        size_t corners[4] = {j*nx + i, j*nx + i + 1, (j + 1)*nx + i + 1, (j + 1)*nx + i};
+        uint32_t edges[4] = {
+            (uint32_t) (j*nx + i),
+            (uint32_t) (nx*ny + j*nx + i + 1),
+            (uint32_t) ((j + 1)*nx + i),
+            (uint32_t) (nx*ny + j*nx + i),
+        };
+        bool inside[4];
+        float sum = 0.0f;
+        for (size_t k = 0; k < 4; ++k) {
+            float s = contour->samples[corners[k]];
+            inside[k] = s >= FIELD_THRESHOLD;
+            sum += s;
+        }
+
+        // The saddles where the opposite corners are inside are told apart by
+        // the average of the corners: if it's inside too, the inside goes
+        // through the middle of the cell
+        bool saddle = inside[0] == inside[2] && inside[1] == inside[3] && inside[0] != inside[1];
+        bool connected = saddle && sum * 0.25f >= FIELD_THRESHOLD;
+        for (size_t k = 0; k < 4; ++k) {
+            if (inside[k] || !inside[(k + 1) & 3]) continue;
+            size_t out = (k + 1) & 3;
+            while (!(inside[out] && !inside[(out + 1) & 3])) out = (out + 1) & 3;
+            if (connected) out = (out + 2) & 3;
+            contour->next[edges[k]] = edges[out];
+        }
+    }
+}
+
+// The point of the contour on the edge
+static V2f contour_edge_point(const Contour *contour, uint32_t edge)
+{
+    size_t nx = contour->nx, ny = contour->ny;
+    size_t a, b;
+    if (edge < nx*ny) {
+        a = edge;
+        b = edge + 1;
+    } else {
+        a = edge - nx*ny;
+        b = a + nx;
+    }
+    float sa = contour->samples[a], sb = contour->samples[b];
+    float t = (FIELD_THRESHOLD - sa) / (sb - sa);
+    V2f pa = contour_sample_pos(contour, a % nx, a / nx);
+    V2f pb = contour_sample_pos(contour, b % nx, b / nx);
+    return v2f(pa.x + t*(pb.x - pa.x), pa.y + t*(pb.y - pa.y));
+}
+
+static void contour_push_point(Contour *contour, V2f point)
+{
+    if (contour->points_count >= contour->points_cap) {
+        contour->points_cap = contour->points_cap == 0 ? 256 : contour->points_cap * 2;
+        contour->points = realloc(contour->points, contour->points_cap * sizeof(*contour->points));
+        if (contour->points == NULL) {
+            fprintf(stderr, "ERROR: could not allocate memory for the contour: %s\n",
+                    strerror(errno));
+            exit(1);
+        }
+    }
+    contour->points[contour->points_count++] = point;
+}
+
+static void contour_push_start(Contour *contour, size_t start)
+{
+    if (contour->count + 1 >= contour->starts_cap) {
+        contour->starts_cap = contour->starts_cap == 0 ? 16 : contour->starts_cap * 2;
+        contour->starts = realloc(contour->starts, contour->starts_cap * sizeof(*contour->starts));
+        if (contour->starts == NULL) {
+            fprintf(stderr, "ERROR: could not allocate memory for the contour: %s\n",
+                    strerror(errno));
+            exit(1);
+        }
+    }
+    contour->starts[contour->count] = (uint32_t) start;
+}
+
+// Extracts the contour of the scene over the frame of width x height pixels
+// from the samples of the field every cell pixels
+void contour_extract(Contour *contour, Pool *pool, size_t width, size_t height, size_t cell,
+                     const Scene *scene)
+{
+    assert(cell > 0);
+    size_t nx = (width + cell - 1) / cell + 3;
+    size_t ny = (height + cell - 1) / cell + 3;
+    if (contour->nx != nx || contour->ny != ny || contour->samples == NULL) {
+        free(contour->samples);
+        free(contour->next);
+        contour->samples = malloc(nx * ny * sizeof(*contour->samples));
+        contour->next = malloc(2 * nx * ny * sizeof(*contour->next));
+        if (contour->samples == NULL || contour->next == NULL) {
+            fprintf(stderr, "ERROR: could not allocate memory for the contour: %s\n",
+                    strerror(errno));
+            exit(1);
+        }
+        contour->nx = nx;
+        contour->ny = ny;
+    }
+    contour->width = width;
+    contour->height = height;
+    contour->cell = cell;
+
+    Contour_Job job = {
+        .contour = contour,
+        .scene = scene,
+    };
+    for (size_t i = 0; i < nx; ++i) {
+        contour->samples[i] = 0.0f;
+        contour->samples[(ny - 1)*nx + i] = 0.0f;
+    }
+    for (size_t j = 0; j < ny; ++j) {
+        contour->samples[j*nx] = 0.0f;
+        contour->samples[j*nx + nx - 1] = 0.0f;
+    }
+    pool_run(pool, (ny - 2 + CONTOUR_BLOCK - 1) / CONTOUR_BLOCK, contour_sample_band, &job);
+    memset(contour->next, 0xFF, 2 * nx * ny * sizeof(*contour->next));
+    pool_run(pool, ny - 1, contour_cells_row, &job);
+
+    // Following a polyline clears its links, so every one is visited once
+    contour->points_count = 0;
+    contour->count = 0;
+    for (uint32_t edge = 0; edge < 2 * nx * ny; ++edge) {
+        if (contour->next[edge] == CONTOUR_NONE) continue;
+        contour_push_start(contour, contour->points_count);
+        uint32_t current = edge;
+        while (contour->next[current] != CONTOUR_NONE) {
+            contour_push_point(contour, contour_edge_point(contour, current));
+            uint32_t next = contour->next[current];
+            contour->next[current] = CONTOUR_NONE;
+            current = next;
+        }
+        contour->count += 1;
+    }
+    contour_push_start(contour, contour->points_count);
+}
+
+// Writes the polylines of the contour as an SVG of the size of the frame
+bool contour_save_svg(const Contour *contour, const char *file_path)
+{
+    FILE *f = fopen(file_path, "wb");
+    if (f == NULL) {
+        fprintf(stderr, "ERROR: could not open file %s: %s\n", file_path, strerror(errno));
+        return false;
+    }
+
+    fprintf(f, "<svg xmlns=\"http://www.w3.org/2000/svg\" width=\"%zu\" height=\"%zu\" viewBox=\"0 0 %zu %zu\">\n",
+            contour->width, contour->height, contour->width, contour->height);
+    fprintf(f, "<path fill=\"none\" stroke=\"black\" d=\"");
+    for (size_t i = 0; i < contour->count; ++i) {
+        for (size_t k = contour->starts[i]; k < contour->starts[i + 1]; ++k) {
+            fprintf(f, "%c%.2f %.2f", k == contour->starts[i] ? 'M' : 'L',
+                    contour->points[k].x, contour->points[k].y);
+        }
+        fprintf(f, "Z");
+    }
+    fprintf(f, "\"/>\n</svg>\n");
+
+    if (ferror(f)) {
+        fprintf(stderr, "ERROR: could not write file %s: %s\n", file_path, strerror(errno));
+        fclose(f);
+        return false;
+    }
+    fclose(f);
+    return true;
+}
+
+void contour_free(Contour *contour)
+{
+    free(contour->samples);
+    free(contour->next);
+    free(contour->points);
+    free(contour->starts);
+    *contour = (Contour) {0};
+}
@@ -0,0 +1,107 @@
+// Forward differencing kernel. Along a scanline the squared distance to a ball
+// is a quadratic in x:
+//
+//     d2(x + 1) = d2(x) + delta(x)
+//     delta(x + 1) = delta(x) + 2
+//
+// so instead of rebuilding the pixel position and the distance for every pixel
+// and every ball, each ball keeps its d2 and delta and advances them with two
+// additions per pixel. They are recomputed from scratch every FDIFF_SPAN pixels
+// to keep the float error from accumulating.
+#include <string.h>
+
+#define FDIFF_SPAN 64
+// The balls are walked in batches so the per-ball state fits on the stack
+#define FDIFF_BATCH 256
+
+static ALWAYS_INLINE void render_region_fdiff_with(const Scene *scene, const Field *base,
+                                                   Pixel32 *pixels, size_t stride,
+                                                   size_t x0, size_t y0, size_t x1, size_t y1,
+                                                   Falloff_Func f)
+{
+    float s[FDIFF_SPAN], r[FDIFF_SPAN], g[FDIFF_SPAN], b[FDIFF_SPAN];
+    float d2[FDIFF_BATCH], delta[FDIFF_BATCH];
+
+    for (size_t y = y0; y < y1; ++y) {
+        float py = (float) y + 0.5f;
+        for (size_t span = x0; span < x1; span += FDIFF_SPAN) {
+            size_t n = x1 - span < FDIFF_SPAN ? x1 - span : FDIFF_SPAN;
+            if (base) {
+                memcpy(s, &base->s[y*stride + span], sizeof(s[0]) * n);
+                memcpy(r, &base->r[y*stride + span], sizeof(r[0]) * n);
+                memcpy(g, &base->g[y*stride + span], sizeof(g[0]) * n);
+                memcpy(b, &base->b[y*stride + span], sizeof(b[0]) * n);
+            } else {
+                memset(s, 0, sizeof(s[0]) * n);
+                memset(r, 0, sizeof(r[0]) * n);
+                memset(g, 0, sizeof(g[0]) * n);
+                memset(b, 0, sizeof(b[0]) * n);
+            }
+
+            for (size_t first = 0; first < scene->count; first += FDIFF_BATCH) {
+                size_t m = scene->count - first < FDIFF_BATCH ? scene->count - first : FDIFF_BATCH;
+                const float *strengths = &scene->strengths[first];
+                const float *inv_radii2 = &scene->inv_radii2[first];
+                const float *cr = &scene->rs[first];
+                const float *cg = &scene->gs[first];
+                const float *cb = &scene->bs[first];
+
+                for (size_t i = 0; i < m; ++i) {
+                    float dx = scene->xs[first + i] - ((float) span + 0.5f);
+                    float dy = scene->ys[first + i] - py;
+                    d2[i] = dx*dx + dy*dy;
+                    delta[i] = 1.0f - 2.0f*dx;
+                }
+
+                for (size_t j = 0; j < n; ++j) {
+                    float sj = 0.0f, rj = 0.0f, gj = 0.0f, bj = 0.0f;
+                    for (size_t i = 0; i < m; ++i) {
+                        float si = strengths[i] * f(d2[i], inv_radii2[i]);
+                        sj += si;
+                        rj += si * cr[i];
+                        gj += si * cg[i];
+                        bj += si * cb[i];
+                        d2[i] += delta[i];
+                        delta[i] += 2.0f;
+                    }
+                    s[j] += sj;
+                    r[j] += rj;
+                    g[j] += gj;
+                    b[j] += bj;
+                }
+            }
+
+            for (size_t j = 0; j < n; ++j) {
+                pixels[y*stride + span + j] = resolve_pixel(scene, s[j], r[j], g[j], b[j]);
+            }
+        }
+    }
+}
+
+static void render_region_fdiff(const Scene *scene, const Field *base,
+                                Pixel32 *pixels, size_t stride,
+                                size_t x0, size_t y0, size_t x1, size_t y1)
+{
+    switch (scene->falloff) {
+    case FALLOFF_INVERSE:
+        render_region_fdiff_with(scene, base, pixels, stride, x0, y0, x1, y1, falloff_inverse);
+        break;
+    case FALLOFF_INVERSE_Q2:
+        render_region_fdiff_with(scene, base, pixels, stride, x0, y0, x1, y1, falloff_inverse_q2);
+        break;
+    case FALLOFF_INVERSE_SQRTF:
+        render_region_fdiff_with(scene, base, pixels, stride, x0, y0, x1, y1, falloff_inverse_sqrtf);
+        break;
+    case FALLOFF_INVERSE4:
+        render_region_fdiff_with(scene, base, pixels, stride, x0, y0, x1, y1, falloff_inverse4);
+        break;
+    case FALLOFF_WYVILL:
+        render_region_fdiff_with(scene, base, pixels, stride, x0, y0, x1, y1, falloff_wyvill);
+        break;
+    case FALLOFF_MURAKAMI:
+        render_region_fdiff_with(scene, base, pixels, stride, x0, y0, x1, y1, falloff_murakami);
+        break;
+    default:
+        assert(0 && "unreachable");
+    }
+}
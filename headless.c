@@ -0,0 +1,54 @@
+// Backend rendering into a buffer of its own with nothing to show it on, for
+// the machines without a display and for measuring. The moving ball follows
+// the script of scripted_ball_pos(), so every run renders the same frames, and
+// the average timings of prof.c are printed at the end.
+#include <stdlib.h>
+#include <time.h>
+
+// Amount of frames when none is requested: 10 seconds at 60 FPS
+#define HEADLESS_FRAMES 600
+
+static double headless_now(void)
+{
+    struct timespec now;
+    if (clock_gettime(CLOCK_MONOTONIC, &now) < 0) {
+        fprintf(stderr, "ERROR: could not get current monotonic time: %s\n",
+                strerror(errno));
+        exit(1);
+    }
+    return now.tv_sec + now.tv_nsec * 1e-9;
+}
+
+void headless_run(size_t frames)
+{
+    if (frames == 0) frames = HEADLESS_FRAMES;
+
+    pixels = malloc(WIDTH*HEIGHT*sizeof(Pixel32));
+    if (pixels == NULL) {
+        fprintf(stderr, "ERROR: could not allocate memory for pixels: %s\n",
+                strerror(errno));
+        exit(1);
+    }
+
+    clear_totals();
+    double begin = headless_now();
+    for (size_t frame = 0; frame < frames; ++frame) {
+        scene_move_ball(&scene, moving_ball, scripted_ball_pos(frame));
+
+        clear_summary();
+        begin_clock("TOTAL");
+        render_frame();
+        end_clock();
+        accumulate_summary();
+    }
+    double elapsed = headless_now() - begin;
+
+    printf("Frames: %zu of %dx%d in %.3lf secs, %.3lf ms per frame, %.2lf FPS\n",
+           frames, WIDTH, HEIGHT, elapsed, elapsed * 1000.0 / frames, frames / elapsed);
+    printf("Average per frame:\n");
+    dump_totals(stdout);
+    print_stats();
+
+    free(pixels);
+    pixels = NULL;
+}
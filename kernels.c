@@ -0,0 +1,142 @@
+#include <assert.h>
+#include <stdio.h>
+#include <string.h>
+
+typedef void (*Render_Region)(const Scene *scene, const Field *base,
+                              Pixel32 *pixels, size_t stride,
+                              size_t x0, size_t y0, size_t x1, size_t y1);
+
+#define ALL_FALLOFFS ((1u << COUNT_FALLOFFS) - 1)
+#define ALL_SHADINGS ((1u << COUNT_SHADINGS) - 1)
+// Every shading but SHADING_LIT, which needs the gradient of the field
+#define UNLIT_SHADINGS (ALL_SHADINGS & ~(1u << SHADING_LIT))
+#define BLEND_ONLY (1u << SHADING_BLEND)
+
+typedef struct {
+    const char *name;
+    const char *description;
+    Render_Region render;
+    // Bit mask of the falloffs the kernel implements, the scenes with any
+    // other falloff are rendered by the scalar kernel instead
+    unsigned int falloffs;
+    // Same for the shadings
+    unsigned int shadings;
+    // NULL if the kernel runs on any CPU
+    int (*supported)(void);
+} Kernel;
+
+#ifdef SIMD_X86
+static int cpu_has_sse2(void)
+{
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("sse2");
+}
+
+static int cpu_has_avx2(void)
+{
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("avx2");
+}
+
+static int cpu_has_avx512(void)
+{
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("avx512f");
+}
+#endif // SIMD_X86
+
+// In the order of -h and of the k key, see kernels_preferred for the speed
+static const Kernel kernels[] = {
+    {"scalar", "reference implementation, one pixel at a time", render_region, ALL_FALLOFFS, ALL_SHADINGS, NULL},
+    {"fdiff", "forward differencing of the distances along scanlines", render_region_fdiff, ALL_FALLOFFS, UNLIT_SHADINGS, NULL},
+    {"unrolled", "scalar unrolled for the scenes of up to 8 balls", render_region_unrolled, ALL_FALLOFFS, BLEND_ONLY, NULL},
+    {"blocked", "balls outside, pixels of an L1 sized block inside", render_region_blocked, ALL_FALLOFFS, UNLIT_SHADINGS, NULL},
+    {"lut", "falloff looked up from a table generated at build time", render_region_lut, (1u << FALLOFF_INVERSE) | (1u << FALLOFF_INVERSE4), UNLIT_SHADINGS, NULL},
+    {"fixed", "fixed point integer arithmetic only", render_region_fixed, 1u << FALLOFF_INVERSE, BLEND_ONLY, NULL},
+    {"swar", "colors accumulated in packed integer lanes", render_region_swar, ALL_FALLOFFS, BLEND_ONLY, NULL},
+#ifdef SIMD_X86
+    {"sse2", "4 pixels at a time", render_region_sse2, ALL_FALLOFFS, UNLIT_SHADINGS, cpu_has_sse2},
+    {"avx2", "8 pixels at a time", render_region_avx2, ALL_FALLOFFS, UNLIT_SHADINGS, cpu_has_avx2},
+    {"avx512", "16 pixels at a time", render_region_avx512, ALL_FALLOFFS, UNLIT_SHADINGS, cpu_has_avx512},
+#endif // SIMD_X86
+};
+#define KERNELS_COUNT (sizeof(kernels)/sizeof(kernels[0]))
+
+int kernel_supported(const Kernel *kernel)
+{
+    return kernel->supported == NULL || kernel->supported();
+}
+
+const Kernel *kernel_by_name(const char *name)
+{
+    for (size_t i = 0; i < KERNELS_COUNT; ++i) {
+        if (strcmp(kernels[i].name, name) == 0) {
+            return &kernels[i];
+        }
+    }
+    return NULL;
+}
+
+// The kernels to render with by default, from the fastest one as measured by
+// `metaballs_bench kernels`. Only the ones good at every amount of balls are
+// here: unrolled is the fastest up to 8 balls and slower than scalar beyond
+// that, and lut, fixed and swar are for the CPUs with weak float throughput,
+// so they are picked only with -k.
+static const char *const kernels_preferred[] = {
+#ifdef SIMD_X86
+    "avx512",
+    "avx2",
+    "sse2",
+#endif // SIMD_X86
+    "blocked",
+};
+#define KERNELS_PREFERRED_COUNT (sizeof(kernels_preferred)/sizeof(kernels_preferred[0]))
+
+// The fastest kernel supported by the CPU
+const Kernel *kernel_best(void)
+{
+    for (size_t i = 0; i < KERNELS_PREFERRED_COUNT; ++i) {
+        const Kernel *kernel = kernel_by_name(kernels_preferred[i]);
+        assert(kernel != NULL);
+        if (kernel_supported(kernel)) return kernel;
+    }
+    return &kernels[0];
+}
+
+// The kernel after the given one supported by the CPU, wrapping around
+const Kernel *kernel_next(const Kernel *kernel)
+{
+    size_t i = (size_t) (kernel - kernels);
+    do {
+        i = (i + 1) % KERNELS_COUNT;
+    } while (!kernel_supported(&kernels[i]));
+    return &kernels[i];
+}
+
+void list_kernels(FILE *stream)
+{
+    for (size_t i = 0; i < KERNELS_COUNT; ++i) {
+        fprintf(stream, "    %-10s %s%s\n",
+                kernels[i].name,
+                kernels[i].description,
+                kernel_supported(&kernels[i]) ? "" : " (not supported by this CPU)");
+    }
+}
+
+// The kernel that actually renders the scene: either the requested one or the
+// scalar one if the requested kernel does not implement the falloff or the
+// shading of the scene
+const Kernel *kernel_for_scene(const Kernel *kernel, const Scene *scene)
+{
+    if ((kernel->falloffs & (1u << scene->falloff)) && (kernel->shadings & (1u << scene->shading))) {
+        return kernel;
+    }
+    return &kernels[0];
+}
+
+void render_scene(Pixel32 *pixels, size_t width, size_t height,
+                  const Scene *scene, const Kernel *kernel)
+{
+    kernel = kernel_for_scene(kernel, scene);
+    kernel->render(scene, NULL, pixels, width, 0, 0, width, height);
+}
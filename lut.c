@@ -0,0 +1,63 @@
+// The inverse and inverse4 falloffs looked up from a table instead of computed.
+// The tables are generated at build time by lutgen.c, so there is no
+// initialization cost at runtime. The FALLOFF_LUT_SIZE floats of a table take
+// 17KiB and stay resident in L1/L2.
+//
+// The relative error of the looked up value is at most 2^-(FALLOFF_LUT_MANTISSA_BITS + 2)
+// (~0.2% for the 1/r falloff), on par with Q_rsqrt() with a single iteration.
+#include <string.h>
+#include "falloff_lut.h"
+
+static inline int32_t falloff_lut_index(float d2)
+{
+    uint32_t bits;
+    memcpy(&bits, &d2, sizeof(bits));
+    int32_t index = (int32_t) (bits >> (23 - FALLOFF_LUT_MANTISSA_BITS))
+                    - ((127 + FALLOFF_LUT_MIN_EXP) << FALLOFF_LUT_MANTISSA_BITS);
+    if (index < 0) return 0;
+    if (index >= FALLOFF_LUT_SIZE) return FALLOFF_LUT_SIZE - 1;
+    return index;
+}
+
+static inline float falloff_lut_inverse(float d2, float inv_r2)
+{
+    (void) inv_r2;
+    return falloff_lut_inv_sqrt[falloff_lut_index(d2)];
+}
+
+static inline float falloff_lut_inverse4(float d2, float inv_r2)
+{
+    (void) inv_r2;
+    return falloff_lut_inv_square[falloff_lut_index(d2)];
+}
+
+static void render_region_lut(const Scene *scene, const Field *base,
+                              Pixel32 *pixels, size_t stride,
+                              size_t x0, size_t y0, size_t x1, size_t y1)
+{
+    switch (scene->falloff) {
+    case FALLOFF_INVERSE:
+        render_region_with(scene, base, pixels, stride, x0, y0, x1, y1, falloff_lut_inverse);
+        break;
+    case FALLOFF_INVERSE4:
+        render_region_with(scene, base, pixels, stride, x0, y0, x1, y1, falloff_lut_inverse4);
+        break;
+    default:
+        assert(0 && "unreachable");
+    }
+}
+
+#ifdef SIMD_X86
+// Same lookup done with a gather, 8 distances at a time. Only used by the
+// benchmark to compare against the hardware reciprocal square root.
+__attribute__((target("avx2")))
+static inline __m256 falloff_lut_avx2(const float *table, __m256 d2)
+{
+    const __m256i offset = _mm256_set1_epi32((127 + FALLOFF_LUT_MIN_EXP) << FALLOFF_LUT_MANTISSA_BITS);
+    __m256i index = _mm256_sub_epi32(_mm256_srli_epi32(_mm256_castps_si256(d2), 23 - FALLOFF_LUT_MANTISSA_BITS),
+                                     offset);
+    index = _mm256_max_epi32(index, _mm256_setzero_si256());
+    index = _mm256_min_epi32(index, _mm256_set1_epi32(FALLOFF_LUT_SIZE - 1));
+    return _mm256_i32gather_ps(table, index, sizeof(float));
+}
+#endif // SIMD_X86
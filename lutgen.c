@@ -0,0 +1,127 @@
+// Generates falloff_lut.h with the tables used by the lut kernel (see lut.c),
+// the fixed kernel (see fixed.c) and the linear shading (see scene.c).
+//
+// The tables are indexed by the squared distance quantized logarithmically: the
+// exponent and the top FALLOFF_LUT_MANTISSA_BITS bits of the mantissa of the
+// float d2. That keeps the relative error of every entry the same across the
+// whole range of distances, which a uniform quantization of d2 can't do
+// without blowing up the size of the table.
+#include <stdio.h>
+#include <math.h>
+
+#define FALLOFF_LUT_MANTISSA_BITS 7
+// The range of the squared distances covered by the table is
+// [2^FALLOFF_LUT_MIN_EXP, 2^FALLOFF_LUT_MAX_EXP), the ones outside of it are
+// clamped
+#define FALLOFF_LUT_MIN_EXP -2
+#define FALLOFF_LUT_MAX_EXP 32
+
+#define FALLOFF_LUT_SIZE ((FALLOFF_LUT_MAX_EXP - FALLOFF_LUT_MIN_EXP) << FALLOFF_LUT_MANTISSA_BITS)
+
+// Resolution of the linear light values converted back to sRGB. 12 bits are
+// enough for every one of the 256 sRGB values to survive the round trip.
+#define SRGB_LUT_SIZE 4096
+
+static void generate_table(FILE *stream, const char *name, double (*f)(double d2))
+{
+    fprintf(stream, "static const float %s[FALLOFF_LUT_SIZE] = {\n", name);
+    for (int e = FALLOFF_LUT_MIN_EXP; e < FALLOFF_LUT_MAX_EXP; ++e) {
+        fprintf(stream, "   ");
+        for (int m = 0; m < (1 << FALLOFF_LUT_MANTISSA_BITS); ++m) {
+            // The middle of the bucket
+            double d2 = ldexp(1.0 + (m + 0.5) / (1 << FALLOFF_LUT_MANTISSA_BITS), e);
+            fprintf(stream, " %.9gf,", f(d2));
+        }
+        fprintf(stream, "\n");
+    }
+    fprintf(stream, "};\n\n");
+}
+
+static double inv_sqrt(double d2)
+{
+    return 1.0 / sqrt(d2);
+}
+
+static double inv_square(double d2)
+{
+    return 1.0 / (d2 * d2);
+}
+
+// Initial guess for the integer reciprocal square root of the fixed kernel (see
+// fixed.c). Indexed by the top 8 bits of a 16 bit normalized m in
+// [2^14, 2^16), each entry is 2^22/sqrt(m) in the middle of its bucket.
+static void generate_fixed_rsqrt_seed(FILE *stream)
+{
+    fprintf(stream, "static const uint16_t fixed_rsqrt_seed[256] = {\n");
+    for (int i = 0; i < 256; i += 16) {
+        fprintf(stream, "   ");
+        for (int j = i; j < i + 16; ++j) {
+            // The indices below 64 are never used since m >= 2^14
+            unsigned int seed = j < 64 ? 0 : (unsigned int) lround(4194304.0 / sqrt((j + 0.5) * 256.0));
+            fprintf(stream, " %u,", seed);
+        }
+        fprintf(stream, "\n");
+    }
+    fprintf(stream, "};\n\n");
+}
+
+static double srgb_to_linear(double c)
+{
+    return c <= 0.04045 ? c / 12.92 : pow((c + 0.055) / 1.055, 2.4);
+}
+
+static double linear_to_srgb(double l)
+{
+    return l <= 0.0031308 ? l * 12.92 : 1.055 * pow(l, 1.0 / 2.4) - 0.055;
+}
+
+// Both directions of the sRGB transfer function: the linear light value of
+// every 8 bit sRGB value, and the 8 bit sRGB value of the linear light values
+// truncated to SRGB_LUT_SIZE steps
+static void generate_srgb_tables(FILE *stream)
+{
+    fprintf(stream, "static const float srgb_to_linear_lut[256] = {\n");
+    for (int i = 0; i < 256; i += 8) {
+        fprintf(stream, "   ");
+        for (int j = i; j < i + 8; ++j) {
+            fprintf(stream, " %#.9gf,", srgb_to_linear(j / 255.0));
+        }
+        fprintf(stream, "\n");
+    }
+    fprintf(stream, "};\n\n");
+
+    // Padded with 3 more entries, so the SIMD kernels can gather 32 bits at
+    // any index and mask out all but the lowest byte
+    fprintf(stream, "static const uint8_t linear_to_srgb_lut[SRGB_LUT_SIZE + 3] = {\n");
+    for (int i = 0; i < SRGB_LUT_SIZE; i += 32) {
+        fprintf(stream, "   ");
+        for (int j = i; j < i + 32; ++j) {
+            // The middle of the bucket, since the index is truncated
+            double l = fmin((j + 0.5) / (SRGB_LUT_SIZE - 1), 1.0);
+            fprintf(stream, " %ld,", lround(linear_to_srgb(l) * 255.0));
+        }
+        fprintf(stream, "\n");
+    }
+    fprintf(stream, "    255, 255, 255,\n");
+    fprintf(stream, "};\n\n");
+}
+
+int main(void)
+{
+    FILE *stream = stdout;
+    fprintf(stream, "// Generated by lutgen.c, do not edit\n");
+    fprintf(stream, "#ifndef FALLOFF_LUT_H_\n");
+    fprintf(stream, "#define FALLOFF_LUT_H_\n\n");
+    fprintf(stream, "#include <stdint.h>\n\n");
+    fprintf(stream, "#define FALLOFF_LUT_MANTISSA_BITS %d\n", FALLOFF_LUT_MANTISSA_BITS);
+    fprintf(stream, "#define FALLOFF_LUT_MIN_EXP %d\n", FALLOFF_LUT_MIN_EXP);
+    fprintf(stream, "#define FALLOFF_LUT_MAX_EXP %d\n", FALLOFF_LUT_MAX_EXP);
+    fprintf(stream, "#define FALLOFF_LUT_SIZE %d\n", FALLOFF_LUT_SIZE);
+    fprintf(stream, "#define SRGB_LUT_SIZE %d\n\n", SRGB_LUT_SIZE);
+    generate_table(stream, "falloff_lut_inv_sqrt", inv_sqrt);
+    generate_table(stream, "falloff_lut_inv_square", inv_square);
+    generate_fixed_rsqrt_seed(stream);
+    generate_srgb_tables(stream);
+    fprintf(stream, "#endif // FALLOFF_LUT_H_\n");
+    return 0;
+}
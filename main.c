@@ -10,12 +10,6 @@
 #ifdef _WIN32
 #define WIN32_LEAN_AND_MEAN
 #include <windows.h>
-#else
-#include <X11/Xlib.h>
-#include <X11/extensions/XShm.h>
-#include <sys/ipc.h>
-#include <sys/shm.h>
-#include <sys/mman.h>
 #endif // _WIN32
 
 #define LA_IMPLEMENTATION
@@ -24,86 +18,30 @@
 #define PROF
 #include "prof.c"
 
-typedef uint32_t Pixel32;
-
-static float Q_rsqrt( float number )
-{
-    static_assert(sizeof( float ) == sizeof( uint32_t ),
-                  "FAST_RSQRT does not work on this architecture");
-
-    uint32_t i;
-    float x2, y;
-    const float threehalfs = 1.5F;
-
-    x2 = number * 0.5F;
-    y  = number;
-    i  = * ( uint32_t * ) &y;                   // evil floating point bit level hacking
-    i  = 0x5f3759df - ( i >> 1 );               // what the fuck?
-    y  = * ( float * ) &i;
-    y  = y * ( threehalfs - ( x2 * y * y ) );   // 1st iteration
-//	y  = y * ( threehalfs - ( x2 * y * y ) );   // 2nd iteration, this can be removed
-
-    return y;
-}
-
-static Pixel32 blend_pixels(Pixel32 a, Pixel32 b, float p)
-{
-    // 0xRRGGBB
-    float ar = (float) ((a >> (8 * 2)) & 0xFF);
-    float br = (float) ((b >> (8 * 2)) & 0xFF);
-    Pixel32 nr = (Pixel32) lerpf(ar, br, p);
-
-    float ag = (float) ((a >> (8 * 1)) & 0xFF);
-    float bg = (float) ((b >> (8 * 1)) & 0xFF);
-    Pixel32 ng = (Pixel32) lerpf(ag, bg, p);
-
-    float ab = (float) ((a >> (8 * 0)) & 0xFF);
-    float bb = (float) ((b >> (8 * 0)) & 0xFF);
-    Pixel32 nb = (Pixel32) lerpf(ab, bb, p);
-
-    return (nr << (8 * 2)) | (ng << (8 * 1)) | (nb << (8 * 0));
-}
-
-#define FAST_RSQRT
-
-#define SQRT_FALLOFF
-
-static void render_scene(Pixel32 *pixels, size_t width, size_t height,
-                         Pixel32 background,
-                         V2f ball1, Pixel32 ball1_color,
-                         V2f ball2, Pixel32 ball2_color)
-{
-    for (int y = 0; (size_t) y < height; ++y) {
-        for (int x = 0; (size_t) x < width; ++x) {
-            V2f p = v2f_sum(v2f(x, y), v2ff(0.5));
-#ifdef SQRT_FALLOFF
-#  ifdef FAST_RSQRT
-            float s1 = Q_rsqrt(v2f_sqrlen(v2f_sub(ball1, p)));
-            float s2 = Q_rsqrt(v2f_sqrlen(v2f_sub(ball2, p)));
-#  else
-            float s1 = 1.0f/sqrtf(v2f_sqrlen(v2f_sub(ball1, p)));
-            float s2 = 1.0f/sqrtf(v2f_sqrlen(v2f_sub(ball2, p)));
-#  endif // FAST_RSQRT
-#else
-            float s1 = 1.0f / v2f_sqrlen(v2f_sub(ball1, p));
-            s1 *= s1;
-            float s2 = 1.0f / v2f_sqrlen(v2f_sub(ball2, p));
-            s2 *= s2;
-#endif // SQRT_FALLOFF
-            float s = s1 + s2;
-
-            if (s >= 0.005f) {
-                pixels[y*width + x] = blend_pixels(ball1_color, ball2_color, s1 / s);
-            } else {
-                pixels[y*width + x] = background;
-            }
-        }
-    }
-}
+#include "scene.c"
+#include "fdiff.c"
+#include "unrolled.c"
+#include "blocked.c"
+#include "simd.c"
+#include "lut.c"
+#include "fixed.c"
+#include "swar.c"
+#include "kernels.c"
+#ifndef _WIN32
+#include "pool.c"
+#include "cache.c"
+#include "spans.c"
+#include "bins.c"
+#include "aa.c"
+#include "contour.c"
+#include "renderer.c"
+#endif // _WIN32
 
 #define WIDTH (16 * 100)
 #define HEIGHT (9 * 100)
 #define BACKGROUND 0x5555AA
+// Pixels between the samples of the field of -contour
+#define CONTOUR_CELL 4
 
 #ifdef _WIN32
 HBITMAP hbmp;
@@ -113,185 +51,320 @@ HDC hdcMem;
 #endif
 
 static Pixel32 *pixels;
+static Scene scene;
+#ifndef _WIN32
+static Pool pool;
+static Renderer renderer;
+#endif // _WIN32
 
 #define MIT_SHM_RENDER
 
 #ifndef _WIN32
 
-int main(void)
+static const char *shift_args(int *argc, char ***argv)
 {
-    Display *display = XOpenDisplay(NULL);
-    if (display == NULL) {
-        fprintf(stderr, "ERROR: could not open the default display\n");
-        exit(1);
-    }
+    assert(*argc > 0);
+    const char *result = **argv;
+    *argc -= 1;
+    *argv += 1;
+    return result;
+}
 
-    Bool mit_shm_available = XShmQueryExtension(display);
-    if (!mit_shm_available) {
-        fprintf(stderr, "WARNING: could not find MIT-SHM extension\n");
+static void log_kernel(const Kernel *kernel, const Scene *scene)
+{
+    const Kernel *actual = kernel_for_scene(kernel, scene);
+    if (actual == kernel) {
+        fprintf(stderr, "INFO: using %s kernel with %s falloff and %s shading\n",
+                kernel->name, falloff_names[scene->falloff], shading_names[scene->shading]);
     } else {
-        fprintf(stderr, "INFO: detected MIT-SHM extension\n");
+        fprintf(stderr, "INFO: using %s kernel with %s falloff and %s shading (%s does not implement them)\n",
+                actual->name, falloff_names[scene->falloff], shading_names[scene->shading], kernel->name);
     }
+}
 
-    Window window = XCreateSimpleWindow(
-                        display,
-                        XDefaultRootWindow(display),
-                        0, 0,
-                        WIDTH, HEIGHT,
-                        0,
-                        0,
-                        0);
-
-    XWindowAttributes wa = {0};
-    XGetWindowAttributes(display, window, &wa);
-
-    XImage *image;
-    XShmSegmentInfo shminfo = {0};
-    if (mit_shm_available) {
-        shminfo.readOnly = True;
-        shminfo.shmid = shmget(IPC_PRIVATE, WIDTH*HEIGHT*sizeof(Pixel32), IPC_CREAT|0777);
-        if (shminfo.shmid < 0) {
-            fprintf(stderr, "ERROR: Could not create a new shared memory segment: %s\n",
-                    strerror(errno));
-            exit(1);
-        }
+// The ball following the mouse or the script
+static size_t moving_ball;
+// Where the backends writing the frames write them, "-" for stdout
+static const char *output_path = "-";
 
-        pixels = shmat(shminfo.shmid, 0, 0);
-        shminfo.shmaddr = (char*) pixels;
-        if (shminfo.shmaddr == (void*) -1) {
-            fprintf(stderr, "ERROR: could not memory map the shared memory segment: %s\n",
-                    strerror(errno));
-            exit(1);
-        }
-
-        if (!XShmAttach(display, &shminfo)) {
-            fprintf(stderr, "ERROR: could not attach the shared memory segment to the server\n");
-            exit(1);
-        }
+// Position of the moving ball in the given frame of the script: a circle
+// around the center of the frame, once every 1.6 seconds at 60 FPS
+static V2f scripted_ball_pos(size_t frame)
+{
+    float t = (float) frame / 60.0f;
+    return v2f_sum(v2f_mul(v2f(WIDTH, HEIGHT), v2ff(0.5)),
+                   v2f_mul(v2f(cosf(4.0f*t), sinf(4.0f*t)), v2ff(HEIGHT * 0.25f)));
+}
 
-        image = XShmCreateImage(display,
-                                wa.visual,
-                                wa.depth,
-                                ZPixmap,
-                                (char *) pixels,
-                                &shminfo,
-                                WIDTH,
-                                HEIGHT);
-    } else {
-        pixels = mmap(NULL,
-                      WIDTH*HEIGHT*sizeof(Pixel32),
-                      PROT_READ|PROT_WRITE,
-                      MAP_PRIVATE|MAP_ANONYMOUS,
-                      -1,
-                      0);
-        if (pixels == MAP_FAILED) {
-            fprintf(stderr, "ERROR: Could not allocate memory for pixels: %s\n",
-                    strerror(errno));
-            exit(1);
-        }
-        image = XCreateImage(display,
-                             wa.visual,
-                             wa.depth,
-                             ZPixmap,
-                             0,
-                             (char*) pixels,
-                             WIDTH,
-                             HEIGHT,
-                             32,
-                             WIDTH * sizeof(Pixel32));
+static void print_stats(void)
+{
+    printf("Evaluated pixels: %.2f%%\n", renderer_evaluated(&renderer) * 100.0f);
+    if (renderer.use_aa) {
+        printf("Supersampled pixels: %.2f%%\n", renderer_supersampled(&renderer) * 100.0f);
     }
+    if (renderer.binned) {
+        printf("Balls per tile: %.2f average, %zu worst\n",
+               bins_average(&renderer.bins), renderer.bins.longest);
+    }
+}
 
-    GC gc = XCreateGC(display, window, 0, NULL);
-
-    Atom wm_delete_window = XInternAtom(display, "WM_DELETE_WINDOW", False);
-    XSetWMProtocols(display, window, &wm_delete_window, 1);
-
-    XSelectInput(display, window, KeyPressMask | PointerMotionMask);
-
-    XMapWindow(display, window);
-
-    float global_time = 0.0f;
-
-    V2f ball2 = v2ff(0.0f);
+// Renders the scene into the pixels of the backend
+static void render_frame(void)
+{
+    begin_clock("SCENE");
+    renderer_render(&renderer, pixels, WIDTH, HEIGHT, &scene);
+    end_clock();
+}
 
-    int CompletionType = XShmGetEventBase (display) + ShmCompletion;
-    int SafeToRender = 1;
+#ifndef NO_X11
+#include "x11.c"
+#endif // NO_X11
+#include "headless.c"
+#include "stream.c"
+#define RING_IMPLEMENTATION
+#include "ring.h"
+#include "shm.c"
+
+typedef struct {
+    const char *name;
+    const char *description;
+    // Renders the scene until quit or, if frames > 0, that many frames
+    void (*run)(size_t frames);
+} Backend;
+
+static const Backend backends[] = {
+#ifndef NO_X11
+    {"x11", "draw into a window of the X server", x11_run},
+#endif // NO_X11
+    {"headless", "render offscreen and print the average timings", headless_run},
+    {"y4m", "write YUV4MPEG2 video for an encoder to read", y4m_run},
+    {"bgra", "write the raw BGRA pixels of every frame", bgra_run},
+    {"shm", "publish the frames in a ring in POSIX shared memory", shm_run},
+};
+#define BACKENDS_COUNT (sizeof(backends)/sizeof(backends[0]))
+
+static void usage(FILE *stream, const char *program)
+{
+    fprintf(stream, "Usage: %s [OPTIONS]\n", program);
+    fprintf(stream, "OPTIONS:\n");
+    fprintf(stream, "    -k <kernel>         render kernel (default: the fastest one supported by the CPU)\n");
+    fprintf(stream, "    -f <falloff>        falloff of the field of the balls (default: %s)\n", falloff_names[FALLOFF_INVERSE]);
+    fprintf(stream, "    -s <shading>        shading of the balls (default: %s)\n", shading_names[SHADING_BLEND]);
+    fprintf(stream, "    -j <threads>        amount of rendering threads (default: amount of CPUs)\n");
+    fprintf(stream, "    -no-spans           evaluate every pixel instead of only the ones near the balls\n");
+    fprintf(stream, "    -no-quadtree        don't skip the blocks of the frame proven to be background\n");
+    fprintf(stream, "    -no-bins            evaluate every ball in every tile\n");
+    fprintf(stream, "    -no-static-cache    evaluate the static balls every frame\n");
+    fprintf(stream, "    -aa                 supersample the pixels on the edges of the balls\n");
+    fprintf(stream, "    -contour <file>     save the contour of the balls as SVG instead of opening a window\n");
+    fprintf(stream, "    -b <backend>        where the frames go (default: %s)\n", backends[0].name);
+    fprintf(stream, "    -n <frames>         amount of frames to render (default: until quit with a window, %d otherwise)\n", HEADLESS_FRAMES);
+    fprintf(stream, "    -o <file>           file or FIFO to write the video to, - for stdout (default: -),\n");
+    fprintf(stream, "                        or the name of the shared memory (default: %s)\n", SHM_NAME);
+    fprintf(stream, "    -h                  print this help and exit\n");
+    fprintf(stream, "KEYS:\n");
+    fprintf(stream, "    k                   switch to the next kernel\n");
+    fprintf(stream, "    f                   switch to the next falloff\n");
+    fprintf(stream, "    s                   switch to the next shading\n");
+    fprintf(stream, "    a                   toggle the anti-aliasing of the edges\n");
+    fprintf(stream, "    p                   print the timings of the last frame\n");
+    fprintf(stream, "    q                   quit\n");
+    fprintf(stream, "BACKENDS:\n");
+    for (size_t i = 0; i < BACKENDS_COUNT; ++i) {
+        fprintf(stream, "    %-10s %s\n", backends[i].name, backends[i].description);
+    }
+    fprintf(stream, "KERNELS:\n");
+    list_kernels(stream);
+    fprintf(stream, "FALLOFFS:\n");
+    for (Falloff f = 0; f < COUNT_FALLOFFS; ++f) {
+        fprintf(stream, "    %s\n", falloff_names[f]);
+    }
+    fprintf(stream, "SHADINGS:\n");
+    for (Shading s = 0; s < COUNT_SHADINGS; ++s) {
+        fprintf(stream, "    %s\n", shading_names[s]);
+    }
+}
 
-    int quit = 0;
-    while (!quit) {
-        while (XPending(display) > 0) {
-            XEvent event = {0};
-            XNextEvent(display, &event);
-            switch (event.type) {
-            case KeyPress: {
-                switch (XLookupKeysym(&event.xkey, 0)) {
-                case 'q':
-                    quit = 1;
-                    break;
-                case 'p':
-                    dump_summary(stdout);
-                    break;
-                }
+int main(int argc, char **argv)
+{
+    const char *program = shift_args(&argc, &argv);
+    const Kernel *kernel = kernel_best();
+    size_t threads = pool_default_threads();
+    Falloff falloff = FALLOFF_INVERSE;
+    Shading shading = SHADING_BLEND;
+    bool use_spans = true;
+    bool use_quadtree = true;
+    bool use_bins = true;
+    bool use_static_cache = true;
+    bool use_aa = false;
+    const char *contour_path = NULL;
+    const Backend *backend = &backends[0];
+    size_t frames = 0;
+
+    while (argc > 0) {
+        const char *flag = shift_args(&argc, &argv);
+        if (strcmp(flag, "-k") == 0) {
+            if (argc <= 0) {
+                usage(stderr, program);
+                fprintf(stderr, "ERROR: no value provided for flag %s\n", flag);
+                exit(1);
             }
-            break;
-
-            case MotionNotify: {
-                ball2 = v2f(event.xmotion.x, event.xmotion.y);
+            const char *name = shift_args(&argc, &argv);
+            kernel = kernel_by_name(name);
+            if (kernel == NULL) {
+                usage(stderr, program);
+                fprintf(stderr, "ERROR: unknown kernel %s\n", name);
+                exit(1);
             }
-            break;
-
-            case ClientMessage: {
-                if ((Atom) event.xclient.data.l[0] == wm_delete_window) {
-                    quit = 1;
-                }
+            if (!kernel_supported(kernel)) {
+                fprintf(stderr, "ERROR: kernel %s is not supported by this CPU\n", name);
+                exit(1);
             }
-            break;
-
-            default: {
-                if (event.type == CompletionType) {
-                    SafeToRender = 1;
-                }
+        } else if (strcmp(flag, "-f") == 0) {
+            if (argc <= 0) {
+                usage(stderr, program);
+                fprintf(stderr, "ERROR: no value provided for flag %s\n", flag);
+                exit(1);
             }
+            const char *name = shift_args(&argc, &argv);
+            for (falloff = 0; falloff < COUNT_FALLOFFS; ++falloff) {
+                if (strcmp(falloff_names[falloff], name) == 0) break;
             }
-        }
-
-        struct timespec now;
-        if (clock_gettime(CLOCK_MONOTONIC, &now) < 0) {
-            fprintf(stderr, "ERROR: could not get current monotonic time: %s\n",
-                    strerror(errno));
-            exit(1);
-        }
-        global_time = (float) now.tv_sec + now.tv_nsec * 0.000000001f;
-
-        V2f ball1 = v2ff(400.0f);
-        // ball2 = v2f_sum(v2f_mul(v2f(WIDTH, HEIGHT), v2ff(0.5)),
-        //                 v2f_mul(v2f(cosf(4.0f*global_time), sinf(4.0f*global_time)),
-        //                         v2ff(HEIGHT * 0.25f)));
-
-        if (SafeToRender) {
-            clear_summary();
-            begin_clock("TOTAL");
-            {
-                begin_clock("SCENE");
-                render_scene(pixels, WIDTH, HEIGHT, BACKGROUND,
-                             ball1, 0xEEEE22,
-                             ball2, 0xEE22EE);
-                end_clock();
-
-                begin_clock("PutImage");
-                if (mit_shm_available) {
-                    XShmPutImage(display, window, gc, image, 0, 0, 0, 0, WIDTH, HEIGHT, True);
-                    SafeToRender = 0;
-                } else {
-                    XPutImage(display, window, gc, image, 0, 0, 0, 0, WIDTH, HEIGHT);
-                }
-                end_clock();
+            if (falloff >= COUNT_FALLOFFS) {
+                usage(stderr, program);
+                fprintf(stderr, "ERROR: unknown falloff %s\n", name);
+                exit(1);
+            }
+        } else if (strcmp(flag, "-s") == 0) {
+            if (argc <= 0) {
+                usage(stderr, program);
+                fprintf(stderr, "ERROR: no value provided for flag %s\n", flag);
+                exit(1);
+            }
+            const char *name = shift_args(&argc, &argv);
+            for (shading = 0; shading < COUNT_SHADINGS; ++shading) {
+                if (strcmp(shading_names[shading], name) == 0) break;
+            }
+            if (shading >= COUNT_SHADINGS) {
+                usage(stderr, program);
+                fprintf(stderr, "ERROR: unknown shading %s\n", name);
+                exit(1);
+            }
+        } else if (strcmp(flag, "-j") == 0) {
+            if (argc <= 0) {
+                usage(stderr, program);
+                fprintf(stderr, "ERROR: no value provided for flag %s\n", flag);
+                exit(1);
+            }
+            const char *value = shift_args(&argc, &argv);
+            char *end = NULL;
+            long n = strtol(value, &end, 10);
+            if (*end != '\0' || n < 1 || n > POOL_THREADS_CAP) {
+                fprintf(stderr, "ERROR: amount of threads must be a number from 1 to %d\n",
+                        POOL_THREADS_CAP);
+                exit(1);
+            }
+            threads = (size_t) n;
+        } else if (strcmp(flag, "-no-spans") == 0) {
+            use_spans = false;
+        } else if (strcmp(flag, "-no-quadtree") == 0) {
+            use_quadtree = false;
+        } else if (strcmp(flag, "-no-bins") == 0) {
+            use_bins = false;
+        } else if (strcmp(flag, "-no-static-cache") == 0) {
+            use_static_cache = false;
+        } else if (strcmp(flag, "-aa") == 0) {
+            use_aa = true;
+        } else if (strcmp(flag, "-contour") == 0) {
+            if (argc <= 0) {
+                usage(stderr, program);
+                fprintf(stderr, "ERROR: no value provided for flag %s\n", flag);
+                exit(1);
+            }
+            contour_path = shift_args(&argc, &argv);
+        } else if (strcmp(flag, "-b") == 0) {
+            if (argc <= 0) {
+                usage(stderr, program);
+                fprintf(stderr, "ERROR: no value provided for flag %s\n", flag);
+                exit(1);
             }
-            end_clock();
+            const char *name = shift_args(&argc, &argv);
+            backend = NULL;
+            for (size_t i = 0; i < BACKENDS_COUNT; ++i) {
+                if (strcmp(backends[i].name, name) == 0) backend = &backends[i];
+            }
+            if (backend == NULL) {
+                usage(stderr, program);
+                fprintf(stderr, "ERROR: unknown backend %s\n", name);
+                exit(1);
+            }
+        } else if (strcmp(flag, "-n") == 0) {
+            if (argc <= 0) {
+                usage(stderr, program);
+                fprintf(stderr, "ERROR: no value provided for flag %s\n", flag);
+                exit(1);
+            }
+            const char *value = shift_args(&argc, &argv);
+            char *end = NULL;
+            long n = strtol(value, &end, 10);
+            if (*end != '\0' || n < 1) {
+                fprintf(stderr, "ERROR: amount of frames must be a positive number\n");
+                exit(1);
+            }
+            frames = (size_t) n;
+        } else if (strcmp(flag, "-o") == 0) {
+            if (argc <= 0) {
+                usage(stderr, program);
+                fprintf(stderr, "ERROR: no value provided for flag %s\n", flag);
+                exit(1);
+            }
+            output_path = shift_args(&argc, &argv);
+        } else if (strcmp(flag, "-h") == 0) {
+            usage(stdout, program);
+            exit(0);
+        } else {
+            usage(stderr, program);
+            fprintf(stderr, "ERROR: unknown flag %s\n", flag);
+            exit(1);
         }
     }
+    fprintf(stderr, "INFO: rendering with %zu threads\n", threads);
+    pool_init(&pool, threads);
+    renderer_init(&renderer, kernel, &pool);
+    renderer.use_spans = use_spans;
+    renderer.use_quadtree = use_quadtree;
+    renderer.use_bins = use_bins;
+    renderer.use_static_cache = use_static_cache;
+    renderer.use_aa = use_aa;
+
+    if (contour_path != NULL) {
+        // The balls of the window with the moving one in the middle of it
+        scene_clear(&scene, BACKGROUND);
+        scene_set_falloff(&scene, falloff);
+        scene_push_ball(&scene, v2ff(400.0f), 1.0f, 0xEE22EE);
+        scene_push_ball(&scene, v2f(WIDTH * 0.5f, HEIGHT * 0.5f), 1.0f, 0xEEEE22);
+
+        Contour contour = {0};
+        contour_extract(&contour, &pool, WIDTH, HEIGHT, CONTOUR_CELL, &scene);
+        if (!contour_save_svg(&contour, contour_path)) exit(1);
+        fprintf(stderr, "INFO: saved %zu polylines of %zu points to %s\n",
+                contour.count, contour.points_count, contour_path);
+        contour_free(&contour);
+        return 0;
+    }
+
+    scene_clear(&scene, BACKGROUND);
+    scene_set_falloff(&scene, falloff);
+    scene_set_shading(&scene, shading);
+    log_kernel(kernel, &scene);
+    size_t ball1 = scene_push_ball(&scene, v2ff(400.0f), 1.0f, 0xEE22EE);
+    scene_set_static(&scene, ball1, true);
+    moving_ball = scene_push_ball(&scene, v2ff(0.0f), 1.0f, 0xEEEE22);
 
-    XCloseDisplay(display);
+    fprintf(stderr, "INFO: using %s backend\n", backend->name);
+    backend->run(frames);
+    renderer_free(&renderer);
+    pool_destroy(&pool);
 
     return 0;
 }
@@ -311,15 +384,16 @@ DWORD WINAPI tickThreadProc(HANDLE handle)
     hdcMem = CreateCompatibleDC(hdc);
     HBITMAP hbmOld = (HBITMAP)SelectObject(hdcMem, hbmp);
 
-    V2f ball1 = v2ff(400.0f);
-    V2f ball2 = v2ff(0.0f);
+    scene_clear(&scene, BACKGROUND);
+    scene_push_ball(&scene, v2ff(400.0f), 1.0f, 0xEE22EE);
+    size_t ball2 = scene_push_ball(&scene, v2ff(0.0f), 1.0f, 0xEEEE22);
 
     for (;;) {
         POINT p;
         if (GetCursorPos(&p) && ScreenToClient(hwnd, &p)) {
-            ball2 = v2f(p.x, p.y);
+            scene_move_ball(&scene, ball2, v2f(p.x, p.y));
 
-            render_scene(pixels, WIDTH, HEIGHT, BACKGROUND, ball1, 0xEEEE22, ball2, 0xEE22EE);
+            render_scene(pixels, WIDTH, HEIGHT, &scene, kernel_best());
             BitBlt(hdc, 0, 0, WIDTH, HEIGHT, hdcMem, 0, 0, SRCCOPY);
         }
     }
@@ -0,0 +1,189 @@
+// Persistent pool of worker threads. The threads are created once at startup
+// and sleep between the frames, so splitting a frame into tasks does not cost
+// a thread creation every time.
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <unistd.h>
+
+#define POOL_THREADS_CAP 256
+
+typedef void (*Pool_Task)(void *arg, size_t index);
+
+typedef struct Pool Pool;
+
+typedef struct {
+    Pool *pool;
+    // See pool_thread_index()
+    size_t index;
+} Pool_Worker;
+
+struct Pool {
+    pthread_t threads[POOL_THREADS_CAP];
+    Pool_Worker workers[POOL_THREADS_CAP];
+    // Worker threads only, the thread that calls pool_run() works too
+    size_t threads_count;
+
+    pthread_mutex_t mutex;
+    pthread_cond_t start;
+    pthread_cond_t finish;
+    size_t generation;
+    size_t working;
+    bool quit;
+
+    Pool_Task task;
+    void *arg;
+    size_t tasks_count;
+    atomic_size_t next_task;
+};
+
+static _Thread_local size_t pool_thread;
+
+// Index of the calling thread among the threads running the tasks of the pool
+// from 0 for the one calling pool_run() to pool_threads() - 1, for keeping
+// scratch memory per thread
+static inline size_t pool_thread_index(void)
+{
+    return pool_thread;
+}
+
+// Amount of the threads running the tasks including the one calling pool_run()
+static inline size_t pool_threads(const Pool *pool)
+{
+    return pool->threads_count + 1;
+}
+
+static void pool_drain(Pool *pool)
+{
+    for (;;) {
+        size_t index = atomic_fetch_add(&pool->next_task, 1);
+        if (index >= pool->tasks_count) break;
+        pool->task(pool->arg, index);
+    }
+}
+
+static void *pool_worker(void *arg)
+{
+    Pool_Worker *worker = arg;
+    Pool *pool = worker->pool;
+    pool_thread = worker->index;
+    size_t generation = 0;
+
+    pthread_mutex_lock(&pool->mutex);
+    for (;;) {
+        while (!pool->quit && pool->generation == generation) {
+            pthread_cond_wait(&pool->start, &pool->mutex);
+        }
+        if (pool->quit) break;
+        generation = pool->generation;
+        pthread_mutex_unlock(&pool->mutex);
+
+        pool_drain(pool);
+
+        pthread_mutex_lock(&pool->mutex);
+        pool->working -= 1;
+        if (pool->working == 0) {
+            pthread_cond_signal(&pool->finish);
+        }
+    }
+    pthread_mutex_unlock(&pool->mutex);
+
+    return NULL;
+}
+
+size_t pool_default_threads(void)
+{
+    long n = sysconf(_SC_NPROCESSORS_ONLN);
+    if (n < 1) return 1;
+    if (n > POOL_THREADS_CAP) return POOL_THREADS_CAP;
+    return (size_t) n;
+}
+
+// threads is the total amount of threads working on the tasks including the
+// one calling pool_run(), so 1 means no worker threads at all
+void pool_init(Pool *pool, size_t threads)
+{
+    assert(threads > 0);
+    assert(threads <= POOL_THREADS_CAP);
+
+    pool->threads_count = 0;
+    pool->generation = 0;
+    pool->working = 0;
+    pool->quit = false;
+    pool->tasks_count = 0;
+    atomic_init(&pool->next_task, 0);
+    pthread_mutex_init(&pool->mutex, NULL);
+    pthread_cond_init(&pool->start, NULL);
+    pthread_cond_init(&pool->finish, NULL);
+
+    for (size_t i = 0; i + 1 < threads; ++i) {
+        pool->workers[i].pool = pool;
+        pool->workers[i].index = i + 1;
+        int err = pthread_create(&pool->threads[i], NULL, pool_worker, &pool->workers[i]);
+        if (err != 0) {
+            fprintf(stderr, "ERROR: could not create a worker thread: %s\n",
+                    strerror(err));
+            exit(1);
+        }
+        pool->threads_count += 1;
+    }
+}
+
+void pool_destroy(Pool *pool)
+{
+    pthread_mutex_lock(&pool->mutex);
+    pool->quit = true;
+    pthread_cond_broadcast(&pool->start);
+    pthread_mutex_unlock(&pool->mutex);
+
+    for (size_t i = 0; i < pool->threads_count; ++i) {
+        pthread_join(pool->threads[i], NULL);
+    }
+
+    pthread_cond_destroy(&pool->finish);
+    pthread_cond_destroy(&pool->start);
+    pthread_mutex_destroy(&pool->mutex);
+}
+
+// Calls task(arg, i) for every i in [0, tasks_count) spread across all the
+// threads of the pool. Returns only after all of the tasks are finished.
+void pool_run(Pool *pool, size_t tasks_count, Pool_Task task, void *arg)
+{
+    pthread_mutex_lock(&pool->mutex);
+    pool->task = task;
+    pool->arg = arg;
+    pool->tasks_count = tasks_count;
+    atomic_store(&pool->next_task, 0);
+    pool->working = pool->threads_count;
+    pool->generation += 1;
+    pthread_cond_broadcast(&pool->start);
+    pthread_mutex_unlock(&pool->mutex);
+
+    pool_drain(pool);
+
+    pthread_mutex_lock(&pool->mutex);
+    while (pool->working > 0) {
+        pthread_cond_wait(&pool->finish, &pool->mutex);
+    }
+    pthread_mutex_unlock(&pool->mutex);
+}
+
+// 64x64 pixels is 16KiB of output which together with the ball arrays of a
+// typical scene stays within L1/L2
+#define TILE_SIZE 64
+
+static inline size_t tiles_count(size_t width, size_t height)
+{
+    return ((width + TILE_SIZE - 1) / TILE_SIZE) * ((height + TILE_SIZE - 1) / TILE_SIZE);
+}
+
+// Computes the rectangle [x0, x1)x[y0, y1) covered by the tile at index
+static inline void tile_rect(size_t index, size_t width, size_t height,
+                             size_t *x0, size_t *y0, size_t *x1, size_t *y1)
+{
+    size_t tiles_x = (width + TILE_SIZE - 1) / TILE_SIZE;
+    *x0 = (index % tiles_x) * TILE_SIZE;
+    *y0 = (index / tiles_x) * TILE_SIZE;
+    *x1 = *x0 + TILE_SIZE < width  ? *x0 + TILE_SIZE : width;
+    *y1 = *y0 + TILE_SIZE < height ? *y0 + TILE_SIZE : height;
+}
@@ -138,9 +138,97 @@ void dump_summary(FILE *stream)
     clear_summary();
 }
 
+// Sums of the entries of the summaries of many frames. The entries are matched
+// by their label and their parent, so the same label under different parents
+// stays apart.
+typedef struct {
+    const char *label;
+    ptrdiff_t parent;
+    double elapsed;
+} Total;
+
+#define TOTALS_CAP 256
+Total totals[TOTALS_CAP];
+size_t totals_count = 0;
+size_t totals_frames = 0;
+
+void accumulate_entry(ptrdiff_t root, ptrdiff_t parent)
+{
+    ptrdiff_t total = 0;
+    while ((size_t) total < totals_count &&
+           !(totals[total].parent == parent && strcmp(totals[total].label, summary[root].label) == 0)) {
+        total += 1;
+    }
+    if ((size_t) total == totals_count) {
+        assert(totals_count < TOTALS_CAP);
+        totals[totals_count++] = (Total) {
+            .label = summary[root].label,
+            .parent = parent,
+        };
+    }
+    totals[total].elapsed += summary[root].elapsed;
+
+    size_t size = summary[root].size - 1;
+    ptrdiff_t child = root + 1;
+
+    while (size > 0) {
+        accumulate_entry(child, total);
+        size -= summary[child].size;
+        child += summary[child].size;
+    }
+}
+
+// Adds the summary of the last frame to the totals
+void accumulate_summary(void)
+{
+    ptrdiff_t root = 0;
+    while ((size_t) root < summary_count) {
+        accumulate_entry(root, -1);
+        root += summary[root].size;
+    }
+    totals_frames += 1;
+}
+
+void render_totals(FILE *stream, ptrdiff_t parent, size_t level, size_t line_width)
+{
+    for (size_t i = 0; i < totals_count; ++i) {
+        if (totals[i].parent != parent) continue;
+        fprintf(stream, "%*s%-*s%.9lf secs\n",
+                (int) level * 2, "",
+                (int) line_width - (int) level * 2, totals[i].label,
+                totals[i].elapsed / totals_frames);
+        render_totals(stream, (ptrdiff_t) i, level + 1, line_width);
+    }
+}
+
+void clear_totals(void)
+{
+    totals_count = 0;
+    totals_frames = 0;
+}
+
+// Prints the average time of every entry per accumulated frame
+void dump_totals(FILE *stream)
+{
+    size_t line_width = 0;
+    for (size_t i = 0; i < totals_count; ++i) {
+        size_t level = 0;
+        for (ptrdiff_t p = totals[i].parent; p >= 0; p = totals[p].parent) level += 1;
+        size_t entry_line_width = 2 * level + strlen(totals[i].label);
+        if (entry_line_width > line_width) {
+            line_width = entry_line_width;
+        }
+    }
+    if (totals_frames > 0) render_totals(stream, -1, 0, line_width + 2);
+    clear_totals();
+}
+
 #else
 #define begin_clock(...)
 #define end_clock(...)
 #define dump_summary(...)
 #define clear_summary(...)
+#define accumulate_summary(...)
+#define dump_totals(...)
+#define clear_totals(...)
 #endif
@@ -0,0 +1,290 @@
+// Renders the whole frame: keeps the static cache, the bins and the spans of the
+// scene up to date and splits the work into tiles across the threads of the pool.
+#include <stdatomic.h>
+#include <stdbool.h>
+
+// Blocks of the quadtree (see render_quad()) are not split below that. Keeps
+// the blocks aligned to the widest SIMD kernel like the spans are.
+#define QUADTREE_MIN_BLOCK 16
+
+typedef struct {
+    const Kernel *kernel;
+    Pool *pool;
+    bool use_static_cache;
+    bool use_spans;
+    bool use_quadtree;
+    bool use_bins;
+    bool use_aa;
+    Static_Cache static_cache;
+    Spans spans;
+    Bins bins;
+    Aa aa;
+    // Scratch scenes with just the balls of a tile, all of them and the
+    // dynamic ones, for every thread of the pool
+    Scene *tile_scenes;
+    size_t tile_scenes_count;
+    // Statistics of the last frame
+    size_t evaluated;
+    size_t supersampled;
+    size_t pixels;
+    bool binned;
+} Renderer;
+
+typedef struct {
+    // The balls evaluated by the kernel, only the dynamic ones when the field
+    // of the static ones is cached in base
+    const Scene *scene;
+    const Field *base;
+    // All of the balls of the frame, for the bounds of the quadtree
+    const Scene *full;
+    // NULL if every tile goes through all of the balls, indexes full
+    const Bins *bins;
+    // Two per thread of the pool if there are bins
+    Scene *tile_scenes;
+    const Kernel *kernel;
+    // NULL if every pixel is evaluated
+    const Spans *spans;
+    bool quadtree;
+    Pixel32 *pixels;
+    size_t width, height;
+    atomic_size_t evaluated;
+} Tiled_Render;
+
+static inline void fill_background(Pixel32 *pixels, size_t x0, size_t x1, Pixel32 background)
+{
+    for (size_t x = x0; x < x1; ++x) {
+        pixels[x] = background;
+    }
+}
+
+static inline bool row_covered(const Spans *spans, size_t y, size_t x0, size_t x1)
+{
+    const Span *row = &spans->items[y * SPANS_PER_ROW_CAP];
+    for (uint32_t i = 0; i < spans->counts[y]; ++i) {
+        if (row[i].x0 <= x0 && x1 <= row[i].x1) return true;
+    }
+    return false;
+}
+
+// Renders the rectangle with the kernel, skipping the background outside of
+// the spans if there are any. Returns the amount of the evaluated pixels.
+static size_t render_rect(const Tiled_Render *job, const Scene *scene,
+                          size_t x0, size_t y0, size_t x1, size_t y1)
+{
+    if (job->spans == NULL) {
+        job->kernel->render(scene, job->base, job->pixels, job->width, x0, y0, x1, y1);
+        return (x1 - x0) * (y1 - y0);
+    }
+
+    size_t evaluated = 0;
+    Pixel32 background = scene->background;
+    for (size_t y = y0; y < y1;) {
+        // The rows covered by the spans from edge to edge of the rectangle go
+        // to the kernel in one piece
+        size_t covered = y;
+        while (covered < y1 && row_covered(job->spans, covered, x0, x1)) covered += 1;
+        if (covered > y) {
+            job->kernel->render(scene, job->base, job->pixels, job->width, x0, y, x1, covered);
+            evaluated += (x1 - x0) * (covered - y);
+            y = covered;
+            continue;
+        }
+
+        Pixel32 *row = &job->pixels[y * job->width];
+        const Span *spans = &job->spans->items[y * SPANS_PER_ROW_CAP];
+        size_t x = x0;
+        for (uint32_t i = 0; i < job->spans->counts[y] && x < x1; ++i) {
+            size_t sx0 = spans[i].x0 > x ? spans[i].x0 : x;
+            size_t sx1 = spans[i].x1 < x1 ? spans[i].x1 : x1;
+            if (sx0 >= sx1) continue;
+            fill_background(row, x, sx0, background);
+            job->kernel->render(scene, job->base, job->pixels, job->width, sx0, y, sx1, y + 1);
+            evaluated += sx1 - sx0;
+            x = sx1;
+        }
+        fill_background(row, x, x1, background);
+        y += 1;
+    }
+    return evaluated;
+}
+
+// Coarse-to-fine rendering of the rectangle. Where the upper bound of the field
+// over a block stays below the threshold the whole block is background and is
+// filled without evaluating anything. Where the lower bound reaches the
+// threshold every pixel is foreground and goes to the kernel right away.
+// Otherwise the block is split into four until it gets down to
+// QUADTREE_MIN_BLOCK. The bounds are conservative, so the picture is exactly
+// the same as without the quadtree.
+static size_t render_quad(const Tiled_Render *job, const Scene *scene, const Scene *full,
+                          size_t x0, size_t y0, size_t x1, size_t y1)
+{
+    Field_Bounds bounds = field_bounds(full, x0, y0, x1, y1);
+    if (bounds.hi < FIELD_THRESHOLD) {
+        Pixel32 background = scene->background;
+        for (size_t y = y0; y < y1; ++y) {
+            fill_background(&job->pixels[y * job->width], x0, x1, background);
+        }
+        return 0;
+    }
+
+    size_t w = x1 - x0, h = y1 - y0;
+    if (bounds.lo >= FIELD_THRESHOLD) {
+        job->kernel->render(scene, job->base, job->pixels, job->width, x0, y0, x1, y1);
+        return w * h;
+    }
+    if (w <= QUADTREE_MIN_BLOCK && h <= QUADTREE_MIN_BLOCK) {
+        return render_rect(job, scene, x0, y0, x1, y1);
+    }
+
+    // Split at multiples of QUADTREE_MIN_BLOCK only
+    size_t xm = w > QUADTREE_MIN_BLOCK ? x0 + (w / 2 + QUADTREE_MIN_BLOCK - 1) / QUADTREE_MIN_BLOCK * QUADTREE_MIN_BLOCK : x1;
+    size_t ym = h > QUADTREE_MIN_BLOCK ? y0 + (h / 2 + QUADTREE_MIN_BLOCK - 1) / QUADTREE_MIN_BLOCK * QUADTREE_MIN_BLOCK : y1;
+    if (xm > x1) xm = x1;
+    if (ym > y1) ym = y1;
+
+    size_t evaluated = render_quad(job, scene, full, x0, y0, xm, ym);
+    if (xm < x1) evaluated += render_quad(job, scene, full, xm, y0, x1, ym);
+    if (ym < y1) evaluated += render_quad(job, scene, full, x0, ym, xm, y1);
+    if (xm < x1 && ym < y1) evaluated += render_quad(job, scene, full, xm, ym, x1, y1);
+    return evaluated;
+}
+
+static void render_tile(void *arg, size_t index)
+{
+    Tiled_Render *job = arg;
+    size_t x0, y0, x1, y1;
+    tile_rect(index, job->width, job->height, &x0, &y0, &x1, &y1);
+
+    const Scene *scene = job->scene;
+    const Scene *full = job->full;
+    if (job->bins) {
+        Scene *tile_full = &job->tile_scenes[2*pool_thread_index()];
+        Scene *tile_scene = tile_full + 1;
+        const Bins *bins = job->bins;
+        scene_copy_subset(full, &bins->items[bins->offsets[index]],
+                          bins->offsets[index + 1] - bins->offsets[index], tile_full);
+        full = tile_full;
+        if (job->base) {
+            scene_copy_dynamic(tile_full, tile_scene);
+            scene = tile_scene;
+        } else {
+            scene = tile_full;
+        }
+    }
+
+    size_t evaluated = job->quadtree
+        ? render_quad(job, scene, full, x0, y0, x1, y1)
+        : render_rect(job, scene, x0, y0, x1, y1);
+    atomic_fetch_add(&job->evaluated, evaluated);
+}
+
+// Returns the amount of the pixels evaluated by the kernel
+static size_t render_tiles(Pool *pool, Pixel32 *pixels, size_t width, size_t height,
+                           const Scene *scene, const Field *base, const Scene *full,
+                           const Bins *bins, Scene *tile_scenes, const Spans *spans,
+                           bool quadtree, const Kernel *kernel)
+{
+    Tiled_Render job = {
+        .scene = scene,
+        .base = base,
+        .full = full,
+        .bins = bins,
+        .tile_scenes = tile_scenes,
+        .kernel = kernel_for_scene(kernel, scene),
+        .spans = spans,
+        .quadtree = quadtree,
+        .pixels = pixels,
+        .width = width,
+        .height = height,
+    };
+    atomic_init(&job.evaluated, 0);
+    pool_run(pool, tiles_count(width, height), render_tile, &job);
+    return atomic_load(&job.evaluated);
+}
+
+// Same as render_scene() but spreads the tiles of the frame across the pool
+void render_scene_parallel(Pool *pool, Pixel32 *pixels, size_t width, size_t height,
+                           const Scene *scene, const Kernel *kernel)
+{
+    render_tiles(pool, pixels, width, height, scene, NULL, scene, NULL, NULL, NULL, false, kernel);
+}
+
+void renderer_init(Renderer *renderer, const Kernel *kernel, Pool *pool)
+{
+    renderer->kernel = kernel;
+    renderer->pool = pool;
+    renderer->use_static_cache = true;
+    renderer->use_spans = true;
+    renderer->use_quadtree = true;
+    renderer->use_bins = true;
+    renderer->use_aa = false;
+    renderer->tile_scenes = NULL;
+    renderer->tile_scenes_count = 0;
+}
+
+void renderer_free(Renderer *renderer)
+{
+    static_cache_free(&renderer->static_cache);
+    spans_free(&renderer->spans);
+    bins_free(&renderer->bins);
+    aa_free(&renderer->aa);
+    scenes_free(&renderer->tile_scenes, &renderer->tile_scenes_count);
+}
+
+void renderer_render(Renderer *renderer, Pixel32 *pixels, size_t width, size_t height,
+                     const Scene *scene)
+{
+    // The spans and the quadtree are computed from all of the balls, including
+    // the static ones
+    const Scene *full = scene;
+    const Spans *spans = NULL;
+    if (renderer->use_spans) {
+        begin_clock("SPANS");
+        spans_build(&renderer->spans, renderer->pool, width, height, full);
+        end_clock();
+        spans = &renderer->spans;
+    }
+
+    // The inverse falloffs reach every tile, see bins.c
+    const Bins *bins = NULL;
+    if (renderer->use_bins && falloff_is_compact(full->falloff)) {
+        begin_clock("BINS");
+        bins_build(&renderer->bins, width, height, full);
+        end_clock();
+        bins = &renderer->bins;
+        scenes_grow(&renderer->tile_scenes, &renderer->tile_scenes_count, 2*pool_threads(renderer->pool));
+    }
+
+    const Field *base = NULL;
+    if (renderer->use_static_cache) {
+        base = static_cache_update(&renderer->static_cache, renderer->pool, width, height, full);
+        if (base != NULL) scene = &renderer->static_cache.dynamic;
+    }
+
+    renderer->evaluated = render_tiles(renderer->pool, pixels, width, height, scene, base, full,
+                                       bins, renderer->tile_scenes, spans, renderer->use_quadtree,
+                                       renderer->kernel);
+    renderer->supersampled = 0;
+    if (renderer->use_aa) {
+        begin_clock("AA");
+        renderer->supersampled = aa_apply(&renderer->aa, renderer->pool, pixels, width, height,
+                                          full, bins);
+        end_clock();
+    }
+    renderer->binned = bins != NULL;
+    renderer->pixels = width * height;
+}
+
+// Fraction of the pixels of the last frame that were evaluated by the kernel
+float renderer_evaluated(const Renderer *renderer)
+{
+    if (renderer->pixels == 0) return 0.0f;
+    return (float) renderer->evaluated / (float) renderer->pixels;
+}
+
+// Fraction of the pixels of the last frame that were supersampled by aa_apply()
+float renderer_supersampled(const Renderer *renderer)
+{
+    if (renderer->pixels == 0) return 0.0f;
+    return (float) renderer->supersampled / (float) renderer->pixels;
+}
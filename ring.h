@@ -0,0 +1,261 @@
+// Ring of frames in POSIX shared memory. One process renders into the frames
+// of the ring in turn and any number of processes on the same host map it
+// read-only and look at the frames in place: no copies and no syscalls per
+// frame on either side.
+//
+// The producer never waits for the consumers. Every slot of the ring has a
+// sequence number working as a seqlock: it is odd while the frame in the slot
+// is being written and 2*(frame + 1) once frame is complete. A consumer
+// checks the sequence before and after looking at a frame, and if it changed
+// the producer has overwritten the frame in the meantime and it's skipped.
+//
+// Define RING_IMPLEMENTATION in exactly one translation unit before including
+// this file, like with la.h.
+#ifndef RING_H_
+#define RING_H_
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifndef RINGDEF
+#define RINGDEF static inline
+#endif // RINGDEF
+
+// "MBRG"
+#define RING_MAGIC 0x4752424Du
+#define RING_VERSION 1
+
+// Every part of the mapping starts on its own cache line, and the pixels of
+// every frame on their own page
+#define RING_ALIGN 64
+#define RING_FRAME_ALIGN 4096
+
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t width;
+    uint32_t height;
+    // Amount of the frames in the ring
+    uint32_t slots;
+    // Set by the producer once it's done
+    _Atomic uint32_t closed;
+    // Offset of the pixels of the first frame from the start of the mapping
+    // and the distance between the frames, in bytes. The pixels are 32 bit
+    // 0x00RRGGBB, width of them per row.
+    uint64_t frames_offset;
+    uint64_t frame_stride;
+    // Amount of the complete frames, the latest one is head - 1
+    _Alignas(RING_ALIGN) _Atomic uint64_t head;
+} Ring_Header;
+
+typedef struct {
+    _Alignas(RING_ALIGN) _Atomic uint64_t seq;
+} Ring_Slot;
+
+typedef struct {
+    // The whole mapping
+    void *data;
+    size_t size;
+    Ring_Header *header;
+    Ring_Slot *slots;
+    // Frame being written by the producer
+    uint64_t frame;
+    char name[256];
+} Ring;
+
+// Producer. Creates the shared memory object of the name, like "/metaballs",
+// replacing an existing one. Returns false and reports the error to stderr on
+// failure.
+RINGDEF bool ring_create(Ring *ring, const char *name, size_t width, size_t height, size_t slots);
+// The pixels of the next frame, which is invisible to the consumers until
+// ring_end_frame()
+RINGDEF uint32_t *ring_begin_frame(Ring *ring);
+RINGDEF void ring_end_frame(Ring *ring);
+// Marks the ring closed for the consumers and removes its name. The consumers
+// that have it mapped keep it until they close it.
+RINGDEF void ring_destroy(Ring *ring);
+
+// Consumer. Maps an existing ring read-only.
+RINGDEF bool ring_open(Ring *ring, const char *name);
+// Amount of the complete frames so far
+RINGDEF uint64_t ring_head(const Ring *ring);
+RINGDEF bool ring_closed(const Ring *ring);
+// The pixels of the frame if it is still in the ring, NULL if it is not written
+// yet or already overwritten. *seq must be passed to ring_frame_valid() after
+// looking at the pixels.
+RINGDEF const uint32_t *ring_frame(const Ring *ring, uint64_t frame, uint64_t *seq);
+// Whether the frame returned by ring_frame() was not overwritten while it was
+// being looked at. If it was, whatever was read from it is garbage.
+RINGDEF bool ring_frame_valid(const Ring *ring, uint64_t frame, uint64_t seq);
+RINGDEF void ring_close(Ring *ring);
+
+#endif // RING_H_
+
+#ifdef RING_IMPLEMENTATION
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static inline size_t ring_align(size_t x, size_t a)
+{
+    return (x + a - 1) / a * a;
+}
+
+static inline uint32_t *ring_pixels(const Ring *ring, uint64_t frame)
+{
+    const Ring_Header *h = ring->header;
+    return (uint32_t*) ((char*) ring->data + h->frames_offset + (frame % h->slots) * h->frame_stride);
+}
+
+static bool ring_map(Ring *ring, const char *name, int fd, size_t size, int prot)
+{
+    ring->data = mmap(NULL, size, prot, MAP_SHARED, fd, 0);
+    close(fd);
+    if (ring->data == MAP_FAILED) {
+        fprintf(stderr, "ERROR: could not map the shared memory %s: %s\n", name, strerror(errno));
+        ring->data = NULL;
+        return false;
+    }
+    ring->size = size;
+    ring->header = ring->data;
+    ring->slots = (Ring_Slot*) ((char*) ring->data + ring_align(sizeof(Ring_Header), RING_ALIGN));
+    snprintf(ring->name, sizeof(ring->name), "%s", name);
+    return true;
+}
+
+RINGDEF bool ring_create(Ring *ring, const char *name, size_t width, size_t height, size_t slots)
+{
+    memset(ring, 0, sizeof(*ring));
+    size_t slots_offset = ring_align(sizeof(Ring_Header), RING_ALIGN);
+    size_t frames_offset = ring_align(slots_offset + slots * sizeof(Ring_Slot), RING_FRAME_ALIGN);
+    size_t frame_stride = ring_align(width * height * sizeof(uint32_t), RING_FRAME_ALIGN);
+    size_t size = frames_offset + slots * frame_stride;
+
+    // A new object every time, so the consumers still mapping a previous one
+    // never see this one change under them
+    shm_unlink(name);
+    int fd = shm_open(name, O_CREAT | O_EXCL | O_RDWR, 0644);
+    if (fd < 0) {
+        fprintf(stderr, "ERROR: could not create the shared memory %s: %s\n", name, strerror(errno));
+        return false;
+    }
+    if (ftruncate(fd, (off_t) size) < 0) {
+        fprintf(stderr, "ERROR: could not resize the shared memory %s: %s\n", name, strerror(errno));
+        close(fd);
+        shm_unlink(name);
+        return false;
+    }
+    if (!ring_map(ring, name, fd, size, PROT_READ | PROT_WRITE)) {
+        shm_unlink(name);
+        return false;
+    }
+
+    // The object starts zeroed, so every slot is empty, and the magic goes last
+    // for the consumers mapping it right now
+    Ring_Header *h = ring->header;
+    h->version = RING_VERSION;
+    h->width = (uint32_t) width;
+    h->height = (uint32_t) height;
+    h->slots = (uint32_t) slots;
+    h->frames_offset = frames_offset;
+    h->frame_stride = frame_stride;
+    atomic_thread_fence(memory_order_release);
+    h->magic = RING_MAGIC;
+    return true;
+}
+
+RINGDEF uint32_t *ring_begin_frame(Ring *ring)
+{
+    Ring_Slot *slot = &ring->slots[ring->frame % ring->header->slots];
+    atomic_store_explicit(&slot->seq, 2*ring->frame + 1, memory_order_relaxed);
+    // The odd sequence must be visible before any of the new pixels
+    atomic_thread_fence(memory_order_release);
+    return ring_pixels(ring, ring->frame);
+}
+
+RINGDEF void ring_end_frame(Ring *ring)
+{
+    Ring_Slot *slot = &ring->slots[ring->frame % ring->header->slots];
+    atomic_store_explicit(&slot->seq, 2*ring->frame + 2, memory_order_release);
+    atomic_store_explicit(&ring->header->head, ring->frame + 1, memory_order_release);
+    ring->frame += 1;
+}
+
+RINGDEF void ring_destroy(Ring *ring)
+{
+    if (ring->data == NULL) return;
+    atomic_store_explicit(&ring->header->closed, 1, memory_order_release);
+    shm_unlink(ring->name);
+    munmap(ring->data, ring->size);
+    ring->data = NULL;
+}
+
+RINGDEF bool ring_open(Ring *ring, const char *name)
+{
+    memset(ring, 0, sizeof(*ring));
+    int fd = shm_open(name, O_RDONLY, 0);
+    if (fd < 0) {
+        fprintf(stderr, "ERROR: could not open the shared memory %s: %s\n", name, strerror(errno));
+        return false;
+    }
+    struct stat st;
+    if (fstat(fd, &st) < 0 || (size_t) st.st_size < sizeof(Ring_Header)) {
+        fprintf(stderr, "ERROR: %s is not a ring of frames\n", name);
+        close(fd);
+        return false;
+    }
+    if (!ring_map(ring, name, fd, (size_t) st.st_size, PROT_READ)) return false;
+
+    const Ring_Header *h = ring->header;
+    if (h->magic != RING_MAGIC || h->version != RING_VERSION ||
+        h->frames_offset + (size_t) h->slots * h->frame_stride > ring->size) {
+        fprintf(stderr, "ERROR: %s is not a ring of frames of version %d\n", name, RING_VERSION);
+        ring_close(ring);
+        return false;
+    }
+    atomic_thread_fence(memory_order_acquire);
+    return true;
+}
+
+RINGDEF uint64_t ring_head(const Ring *ring)
+{
+    return atomic_load_explicit(&ring->header->head, memory_order_acquire);
+}
+
+RINGDEF bool ring_closed(const Ring *ring)
+{
+    return atomic_load_explicit(&ring->header->closed, memory_order_acquire) != 0;
+}
+
+RINGDEF const uint32_t *ring_frame(const Ring *ring, uint64_t frame, uint64_t *seq)
+{
+    Ring_Slot *slot = &ring->slots[frame % ring->header->slots];
+    *seq = atomic_load_explicit(&slot->seq, memory_order_acquire);
+    if (*seq != 2*frame + 2) return NULL;
+    return ring_pixels(ring, frame);
+}
+
+RINGDEF bool ring_frame_valid(const Ring *ring, uint64_t frame, uint64_t seq)
+{
+    // None of the reads of the pixels may move past the second read of the
+    // sequence
+    atomic_thread_fence(memory_order_acquire);
+    Ring_Slot *slot = &ring->slots[frame % ring->header->slots];
+    return atomic_load_explicit(&slot->seq, memory_order_relaxed) == seq;
+}
+
+RINGDEF void ring_close(Ring *ring)
+{
+    if (ring->data == NULL) return;
+    munmap(ring->data, ring->size);
+    ring->data = NULL;
+}
+
+#endif // RING_IMPLEMENTATION
@@ -0,0 +1,82 @@
+// Consumer of the ring of frames of the shm backend of metaballs (see ring.h).
+// Follows the latest frames and writes them to stdout as raw BGRA for an
+// encoder to read, skipping the ones overwritten before it got to them.
+#define _GNU_SOURCE
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define RING_IMPLEMENTATION
+#include "ring.h"
+
+// How long to wait between the checks for a new frame
+#define RINGCAT_POLL_NSECS 1000000
+
+int main(int argc, char **argv)
+{
+    const char *name = "/metaballs";
+    if (argc > 2 || (argc == 2 && strcmp(argv[1], "-h") == 0)) {
+        fprintf(stderr, "Usage: %s [name]\n", argv[0]);
+        fprintf(stderr, "    Writes the frames of the ring in the shared memory of the name (default: %s)\n", name);
+        fprintf(stderr, "    to stdout as raw BGRA\n");
+        return 1;
+    }
+    if (argc == 2) name = argv[1];
+
+    Ring ring;
+    if (!ring_open(&ring, name)) return 1;
+    size_t width = ring.header->width, height = ring.header->height;
+    size_t size = width * height * sizeof(uint32_t);
+    fprintf(stderr, "INFO: reading %zux%zu frames from a ring of %u\n", width, height, ring.header->slots);
+
+    // stdout may be a slow pipe, so the frame is copied out and checked
+    // before it's written. A consumer that's done with the pixels quickly,
+    // like an upload to a texture, can use them in place instead.
+    uint32_t *frame_pixels = malloc(size);
+    if (frame_pixels == NULL) {
+        fprintf(stderr, "ERROR: could not allocate memory for pixels\n");
+        return 1;
+    }
+
+    uint64_t next = ring_head(&ring);
+    size_t written = 0, skipped = 0;
+    for (;;) {
+        uint64_t head = ring_head(&ring);
+        if (head <= next) {
+            if (ring_closed(&ring)) break;
+            struct timespec poll = {0, RINGCAT_POLL_NSECS};
+            nanosleep(&poll, NULL);
+            continue;
+        }
+        // Too late for anything but the latest one
+        if (head - next > 1) {
+            skipped += head - 1 - next;
+            next = head - 1;
+        }
+
+        uint64_t seq;
+        const uint32_t *pixels = ring_frame(&ring, next, &seq);
+        if (pixels != NULL) {
+            memcpy(frame_pixels, pixels, size);
+            if (ring_frame_valid(&ring, next, seq)) {
+                if (fwrite(frame_pixels, size, 1, stdout) != 1) {
+                    fprintf(stderr, "ERROR: could not write to stdout\n");
+                    return 1;
+                }
+                written += 1;
+            } else {
+                skipped += 1;
+            }
+        } else {
+            skipped += 1;
+        }
+        next += 1;
+    }
+
+    fprintf(stderr, "INFO: wrote %zu frames, skipped %zu\n", written, skipped);
+    free(frame_pixels);
+    ring_close(&ring);
+    return 0;
+}
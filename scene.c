@@ -0,0 +1,1014 @@
+#include <assert.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include "falloff_lut.h"
+
+typedef uint32_t Pixel32;
+
+#ifdef _MSC_VER
+#  define ALWAYS_INLINE __forceinline
+#else
+#  define ALWAYS_INLINE __attribute__((always_inline)) inline
+#endif // _MSC_VER
+
+#define FIELD_THRESHOLD 0.005f
+
+#define SCENE_BALLS_CAP (16*1024)
+
+// Every falloff is compiled into every kernel and picked at runtime
+typedef enum {
+    // 1/r, never reaches zero. The variants differ only in how 1/sqrt(r^2) is
+    // computed, from the fastest and least accurate to the slowest and most
+    // accurate one:
+    //
+    // Q_rsqrt() with a single Newton-Raphson iteration
+    FALLOFF_INVERSE = 0,
+    // Q_rsqrt() with two iterations
+    FALLOFF_INVERSE_Q2,
+    // 1.0f/sqrtf()
+    FALLOFF_INVERSE_SQRTF,
+    // 1/r^4, never reaches zero
+    FALLOFF_INVERSE4,
+    // Compactly supported falloffs of q = r^2/R^2 where R is the radius of the
+    // ball. Both are exactly zero for r >= R.
+    //
+    // Wyvill's soft objects: 1 - 4/9 q^3 + 17/9 q^2 - 22/9 q
+    FALLOFF_WYVILL,
+    // Murakami's (1 - q)^2
+    FALLOFF_MURAKAMI,
+    COUNT_FALLOFFS,
+} Falloff;
+
+const char *falloff_names[COUNT_FALLOFFS] = {
+    [FALLOFF_INVERSE] = "inverse",
+    [FALLOFF_INVERSE_Q2] = "inverse-q2",
+    [FALLOFF_INVERSE_SQRTF] = "inverse-sqrtf",
+    [FALLOFF_INVERSE4] = "inverse4",
+    [FALLOFF_WYVILL] = "wyvill",
+    [FALLOFF_MURAKAMI] = "murakami",
+};
+
+// How the field-weighted color channels of a pixel turn into its color. Like
+// the falloffs, every shading is picked at runtime.
+typedef enum {
+    // The colors of the balls mixed proportionally to their field
+    SHADING_BLEND = 0,
+    // The pixel is colored from a gradient going through the colors of all of
+    // the balls in order. Every ball sits at its own position along the
+    // gradient and the pixel at the average of the positions weighted by the
+    // field, which is looked up in a precomputed palette. With two balls it is
+    // the same as SHADING_BLEND up to the resolution of the palette.
+    SHADING_PALETTE,
+    // Same as SHADING_BLEND but the colors are mixed in linear light instead
+    // of sRGB, which keeps the mid-tones between two colors from going
+    // muddy. Both conversions are looked up from the tables of lutgen.c.
+    SHADING_LINEAR,
+    // Same colors as SHADING_BLEND lit as if the field was a height map: the
+    // normal of the surface comes from the analytic gradient of the field
+    // accumulated along with the colors (see render_region_lit_with()) and
+    // lights it with a diffuse and a specular term
+    SHADING_LIT,
+    COUNT_SHADINGS,
+} Shading;
+
+const char *shading_names[COUNT_SHADINGS] = {
+    [SHADING_BLEND] = "blend",
+    [SHADING_PALETTE] = "palette",
+    [SHADING_LINEAR] = "linear",
+    [SHADING_LIT] = "lit",
+};
+
+#define PALETTE_SIZE 1024
+
+// Fixed point representation of the balls used by the fixed kernel (see
+// fixed.c): positions in 1/16 of a pixel and strengths as a signed mantissa of
+// FIXED_STRENGTH_BITS bits scaled by a power of two of their own, so a faint
+// ball keeps as many significant bits as a strong one
+#define FIXED_POS_BITS 4
+#define FIXED_STRENGTH_BITS 16
+
+// The balls are stored as a structure of arrays so the kernels can stream
+// through every attribute of every ball without touching the rest. The arrays
+// live in a single allocation with room for capacity balls, which grows with
+// the balls pushed into the scene or copied into it, so a scene of a few balls
+// stays a few cache lines per attribute (see scene_reserve()).
+typedef struct {
+    size_t count;
+    size_t capacity;
+    void *storage;
+    float *xs;
+    float *ys;
+    float *strengths;
+    // Radius of support of the compact falloffs and its 1/R^2. The radius is
+    // never negative, even for the balls of negative strength.
+    float *radii;
+    float *inv_radii2;
+    // Color channels of every ball in the 0..255 range for SHADING_BLEND and
+    // SHADING_LIT, in linear light in the 0..1 range for SHADING_LINEAR, the
+    // position along the gradient in rs for SHADING_PALETTE
+    float *rs;
+    float *gs;
+    float *bs;
+    // The same attributes in fixed point
+    int32_t *xqs;
+    int32_t *yqs;
+    // strength = strengths_q*2^-strengths_shift
+    int32_t *strengths_q;
+    uint8_t *strengths_shift;
+    Pixel32 *colors;
+    // The color channels packed into two 32 bit lanes for swar.c: red and
+    // blue, green and 1
+    uint64_t *rbs;
+    uint64_t *g1s;
+    // Static balls are expected to stay in place for many frames, so their
+    // field can be cached across frames (see cache.c)
+    bool *statics;
+    // Bumped every time the set of static balls or any of them changes
+    size_t statics_version;
+    // Amount of the balls of negative strength. The copies of a part of the
+    // scene keep the one of the whole scene, since the static cache adds the
+    // field of the rest of it back.
+    size_t negatives;
+    Falloff falloff;
+    Shading shading;
+    Pixel32 background;
+    // The gradient of SHADING_PALETTE, rebuilt whenever the colors of the
+    // balls change, and the scale from the positions of the balls to the
+    // indices into it
+    Pixel32 palette[PALETTE_SIZE];
+    float palette_scale;
+} Scene;
+
+// Accumulated field and field-weighted color channels of a frame, indexed the
+// same way as the pixels
+typedef struct {
+    float *s;
+    float *r;
+    float *g;
+    float *b;
+    // Half of the gradient of the field pointing away from the balls, only for
+    // SHADING_LIT (see render_region_lit_with())
+    float *gx;
+    float *gy;
+} Field;
+
+static float Q_rsqrt( float number )
+{
+    static_assert(sizeof( float ) == sizeof( uint32_t ),
+                  "Q_rsqrt does not work on this architecture");
+
+    uint32_t i;
+    float x2, y;
+    const float threehalfs = 1.5F;
+
+    x2 = number * 0.5F;
+    y  = number;
+    i  = * ( uint32_t * ) &y;                   // evil floating point bit level hacking
+    i  = 0x5f3759df - ( i >> 1 );               // what the fuck?
+    y  = * ( float * ) &i;
+    y  = y * ( threehalfs - ( x2 * y * y ) );   // 1st iteration
+//	y  = y * ( threehalfs - ( x2 * y * y ) );   // 2nd iteration, see Q_rsqrt2()
+
+    return y;
+}
+
+// Q_rsqrt() with the 2nd iteration
+static inline float Q_rsqrt2(float number)
+{
+    float x2 = number * 0.5f;
+    float y = Q_rsqrt(number);
+    return y * (1.5f - (x2 * y * y));
+}
+
+static inline bool falloff_is_compact(Falloff falloff)
+{
+    return falloff == FALLOFF_WYVILL || falloff == FALLOFF_MURAKAMI;
+}
+
+// Field contribution of a ball of strength 1.0 at the squared distance d2. All
+// the falloffs take 1/R^2 of the ball even if they don't need it, so the
+// kernels can be written once for all of them.
+typedef float (*Falloff_Func)(float d2, float inv_r2);
+
+static inline float falloff_inverse(float d2, float inv_r2)
+{
+    (void) inv_r2;
+    return Q_rsqrt(d2);
+}
+
+static inline float falloff_inverse_q2(float d2, float inv_r2)
+{
+    (void) inv_r2;
+    return Q_rsqrt2(d2);
+}
+
+static inline float falloff_inverse_sqrtf(float d2, float inv_r2)
+{
+    (void) inv_r2;
+    return 1.0f/sqrtf(d2);
+}
+
+static inline float falloff_inverse4(float d2, float inv_r2)
+{
+    (void) inv_r2;
+    float s = 1.0f / d2;
+    return s * s;
+}
+
+static inline float wyvill(float q)
+{
+    return 1.0f + q*(-22.0f/9.0f + q*(17.0f/9.0f - q*(4.0f/9.0f)));
+}
+
+static inline float falloff_wyvill(float d2, float inv_r2)
+{
+    float q = d2 * inv_r2;
+    return q < 1.0f ? wyvill(q) : 0.0f;
+}
+
+static inline float falloff_murakami(float d2, float inv_r2)
+{
+    float t = 1.0f - d2 * inv_r2;
+    return t > 0.0f ? t * t : 0.0f;
+}
+
+// Distance from the center of the ball i at which its field drops to value.
+// Farther than that the field of the ball is always below value. For the
+// compact falloffs and value == 0 it is exactly the radius of the ball.
+float ball_influence_radius(const Scene *scene, size_t i, float value)
+{
+    float strength = scene->strengths[i];
+    float c = value / strength;
+    switch (scene->falloff) {
+    // A little bit of slack for the approximations of 1/sqrt(x) which can
+    // overshoot the exact value, like the lut kernel does
+    case FALLOFF_INVERSE:
+    case FALLOFF_INVERSE_Q2:
+    case FALLOFF_INVERSE_SQRTF:
+        return 1.01f / c;
+    case FALLOFF_INVERSE4:
+        return 1.01f / sqrtf(sqrtf(c));
+    case FALLOFF_WYVILL: {
+        if (c >= 1.0f) return 0.0f;
+        if (c <= 0.0f) return scene->radii[i];
+        // The polynomial is monotonic on [0, 1], so bisect it
+        float lo = 0.0f, hi = 1.0f;
+        for (int k = 0; k < 32; ++k) {
+            float mid = 0.5f*(lo + hi);
+            if (wyvill(mid) > c) lo = mid; else hi = mid;
+        }
+        return scene->radii[i] * sqrtf(hi);
+    }
+    case FALLOFF_MURAKAMI:
+        if (c >= 1.0f) return 0.0f;
+        if (c <= 0.0f) return scene->radii[i];
+        return scene->radii[i] * sqrtf(1.0f - sqrtf(c));
+    default:
+        assert(0 && "unreachable");
+        return 0.0f;
+    }
+}
+
+// Exact field of a ball of strength 1.0, used for the bounds below instead of
+// the approximations of the kernels
+static inline float falloff_exact(Falloff falloff, float d2, float inv_r2)
+{
+    switch (falloff) {
+    case FALLOFF_INVERSE:
+    case FALLOFF_INVERSE_Q2:
+    case FALLOFF_INVERSE_SQRTF:
+        return 1.0f/sqrtf(d2);
+    case FALLOFF_INVERSE4:
+        return 1.0f/(d2*d2);
+    case FALLOFF_WYVILL:
+        return falloff_wyvill(d2, inv_r2);
+    case FALLOFF_MURAKAMI:
+        return falloff_murakami(d2, inv_r2);
+    default:
+        assert(0 && "unreachable");
+        return 0.0f;
+    }
+}
+
+// Derivative of the falloff with respect to d2 given its value f at d2, so the
+// gradient of the field of a ball of strength 1.0 at the offset (dx, dy) from
+// its center is 2*falloff_slope()*(dx, dy). The 1/r variants reuse f as their
+// 1/r: the derivative of d2^(-1/2) is -1/2*d2^(-3/2).
+static inline float falloff_slope(Falloff falloff, float f, float d2, float inv_r2)
+{
+    switch (falloff) {
+    case FALLOFF_INVERSE:
+    case FALLOFF_INVERSE_Q2:
+    case FALLOFF_INVERSE_SQRTF:
+        return -0.5f * f*f*f;
+    case FALLOFF_INVERSE4:
+        return -2.0f * f / d2;
+    case FALLOFF_WYVILL: {
+        float q = d2 * inv_r2;
+        return q < 1.0f ? inv_r2 * (-22.0f/9.0f + q*(34.0f/9.0f - q*(12.0f/9.0f))) : 0.0f;
+    }
+    case FALLOFF_MURAKAMI: {
+        float t = 1.0f - d2 * inv_r2;
+        return t > 0.0f ? -2.0f * t * inv_r2 : 0.0f;
+    }
+    default:
+        assert(0 && "unreachable");
+        return 0.0f;
+    }
+}
+
+// Leaves room for the approximations of the falloff in the kernels, the same
+// slack ball_influence_radius() has
+#define FIELD_BOUNDS_SLACK 0.01f
+
+typedef struct {
+    float lo, hi;
+} Field_Bounds;
+
+// Bounds of the field of all the balls of the scene over the points of the
+// rectangle [left, right]x[top, bottom]. Every falloff decreases with the
+// distance, so a ball contributes the most at the point of the rectangle
+// closest to its center and the least at the farthest corner.
+Field_Bounds field_bounds_rect(const Scene *scene, float left, float top, float right, float bottom)
+{
+    Field_Bounds bounds = {0};
+    for (size_t i = 0; i < scene->count; ++i) {
+        float strength = scene->strengths[i];
+        if (strength == 0.0f) continue;
+
+        float x = scene->xs[i], y = scene->ys[i];
+        float nx = x < left ? left - x : x > right ? x - right : 0.0f;
+        float ny = y < top ? top - y : y > bottom ? y - bottom : 0.0f;
+        float fx = fmaxf(fabsf(x - left), fabsf(x - right));
+        float fy = fmaxf(fabsf(y - top), fabsf(y - bottom));
+
+        float near = falloff_exact(scene->falloff, nx*nx + ny*ny, scene->inv_radii2[i]);
+        float far = falloff_exact(scene->falloff, fx*fx + fy*fy, scene->inv_radii2[i]);
+        if (strength >= 0.0f) {
+            bounds.lo += strength * far;
+            bounds.hi += strength * near;
+        } else {
+            bounds.lo += strength * near;
+            bounds.hi += strength * far;
+        }
+    }
+    bounds.lo -= fabsf(bounds.lo) * FIELD_BOUNDS_SLACK;
+    bounds.hi += fabsf(bounds.hi) * FIELD_BOUNDS_SLACK;
+    return bounds;
+}
+
+// Bounds of the field over the pixel centers of the rectangle [x0, x1)x[y0, y1)
+Field_Bounds field_bounds(const Scene *scene, size_t x0, size_t y0, size_t x1, size_t y1)
+{
+    return field_bounds_rect(scene, (float) x0 + 0.5f, (float) y0 + 0.5f,
+                             (float) x1 - 0.5f, (float) y1 - 0.5f);
+}
+
+static inline Pixel32 pack_rgb(float r, float g, float b)
+{
+    // 0xRRGGBB
+    return ((Pixel32) r << (8 * 2)) | ((Pixel32) g << (8 * 1)) | ((Pixel32) b << (8 * 0));
+}
+
+// 8 bit sRGB value of the linear light value scaled from 0..1 to
+// 0..SRGB_LUT_SIZE - 1. The table is built for truncating the index, and the
+// negative indices turn into huge unsigned ones, so a single comparison
+// clamps both ends.
+static inline Pixel32 linear_to_srgb(float t)
+{
+    uint32_t index = (uint32_t) (int32_t) t;
+    return linear_to_srgb_lut[index < SRGB_LUT_SIZE - 1 ? index : SRGB_LUT_SIZE - 1];
+}
+
+// The color of a pixel is the average of the colors of the balls weighted by
+// their fields, which only the negative balls can pull out of the range of
+// the channel, [0, top]. The NaNs at the center of a 1/r ball end up at 0.
+static inline float clamp_channel(float c, float top)
+{
+    c = c > 0.0f ? c : 0.0f;
+    return c < top ? c : top;
+}
+
+// Turns the accumulated field s and field-weighted color channels into the
+// final pixel
+static inline Pixel32 resolve_pixel(const Scene *scene, float s, float r, float g, float b)
+{
+    if (s < FIELD_THRESHOLD) return scene->background;
+
+    float inv = 1.0f / s;
+    switch (scene->shading) {
+    // Without the gradient the lit shading has nothing to light, which only
+    // happens to the pixels of the kernels that don't implement it
+    case SHADING_BLEND:
+    case SHADING_LIT:
+        r *= inv;
+        g *= inv;
+        b *= inv;
+        // The clamping costs the scenes without negative balls more than a
+        // branch per pixel that always goes the same way
+        if (scene->negatives > 0) {
+            r = clamp_channel(r, 255.0f);
+            g = clamp_channel(g, 255.0f);
+            b = clamp_channel(b, 255.0f);
+        }
+        return pack_rgb(r, g, b);
+    case SHADING_PALETTE: {
+        float t = r * inv * scene->palette_scale + 0.5f;
+        // Negated, so the NaN of a pixel right at the center of a ball can't
+        // turn into an index
+        if (!(t > 0.0f)) return scene->palette[0];
+        if (t >= PALETTE_SIZE - 1) return scene->palette[PALETTE_SIZE - 1];
+        return scene->palette[(int32_t) t];
+    }
+    case SHADING_LINEAR:
+        inv *= (float) (SRGB_LUT_SIZE - 1);
+        r *= inv;
+        g *= inv;
+        b *= inv;
+        if (scene->negatives > 0) {
+            r = clamp_channel(r, (float) (SRGB_LUT_SIZE - 1));
+            g = clamp_channel(g, (float) (SRGB_LUT_SIZE - 1));
+            b = clamp_channel(b, (float) (SRGB_LUT_SIZE - 1));
+        }
+        return (linear_to_srgb(r) << (8 * 2))
+             | (linear_to_srgb(g) << (8 * 1))
+             | (linear_to_srgb(b) << (8 * 0));
+    default:
+        assert(0 && "unreachable");
+        return scene->background;
+    }
+}
+
+// How much the gradient of the field relative to the field itself tilts the
+// surface of SHADING_LIT. The relative gradient of a single 1/r ball is 1/r, so
+// the surface of such a ball ~100 pixels in radius ends up tilted by about 30
+// degrees at the edge.
+#define LIT_RELIEF 64.0f
+#define LIT_AMBIENT 0.35f
+#define LIT_DIFFUSE 0.65f
+#define LIT_SPECULAR 0.5f
+
+// Direction towards the light coming from the top left and the half way
+// vector between it and the viewer looking along -z, both normalized
+static const float lit_light[3] = {-0.40824829f, -0.40824829f, 0.81649658f};
+static const float lit_half[3] = {-0.21410169f, -0.21410169f, 0.95306455f};
+
+// resolve_pixel() for SHADING_LIT. (gx, gy) is half of the gradient of the
+// field pointing away from the balls, the way render_region_lit_with()
+// accumulates it.
+static inline Pixel32 resolve_pixel_lit(const Scene *scene, float s, float r, float g, float b,
+                                        float gx, float gy)
+{
+    if (s < FIELD_THRESHOLD) return scene->background;
+
+    float inv = 1.0f / s;
+    // The normal of the height map s(x, y) is (-ds/dx, -ds/dy, 1) up to the
+    // scale of the relief, so with the gradient pointing away from the balls
+    // it's (2gx, 2gy, 1)
+    float k = 2.0f * LIT_RELIEF * inv;
+    float nx = k * gx, ny = k * gy;
+    float n_inv = 1.0f / sqrtf(nx*nx + ny*ny + 1.0f);
+    float diffuse = (nx*lit_light[0] + ny*lit_light[1] + lit_light[2]) * n_inv;
+    float specular = (nx*lit_half[0] + ny*lit_half[1] + lit_half[2]) * n_inv;
+    diffuse = diffuse > 0.0f ? diffuse : 0.0f;
+    specular = specular > 0.0f ? specular : 0.0f;
+    // specular^32
+    specular *= specular;
+    specular *= specular;
+    specular *= specular;
+    specular *= specular;
+    specular *= specular;
+
+    float light = (LIT_AMBIENT + LIT_DIFFUSE * diffuse) * inv;
+    float shine = LIT_SPECULAR * 255.0f * specular;
+    r = r * light + shine;
+    g = g * light + shine;
+    b = b * light + shine;
+    if (scene->negatives > 0) {
+        r = clamp_channel(r, 255.0f);
+        g = clamp_channel(g, 255.0f);
+        b = clamp_channel(b, 255.0f);
+    }
+    return pack_rgb(r < 255.0f ? r : 255.0f, g < 255.0f ? g : 255.0f, b < 255.0f ? b : 255.0f);
+}
+
+// Linear gradient through the colors of the balls at the positions 0, 1, ...,
+// count - 1
+static void scene_build_palette(Scene *scene)
+{
+    size_t n = scene->count;
+    if (n < 2) {
+        scene->palette_scale = 0.0f;
+        for (size_t k = 0; k < PALETTE_SIZE; ++k) {
+            scene->palette[k] = n == 1 ? scene->colors[0] : scene->background;
+        }
+        return;
+    }
+
+    scene->palette_scale = (float) (PALETTE_SIZE - 1) / (float) (n - 1);
+    for (size_t k = 0; k < PALETTE_SIZE; ++k) {
+        float t = (float) k / scene->palette_scale;
+        size_t i = (size_t) t < n - 2 ? (size_t) t : n - 2;
+        float u = t - (float) i;
+        Pixel32 c0 = scene->colors[i], c1 = scene->colors[i + 1];
+        scene->palette[k] = pack_rgb(lerpf((c0 >> (8 * 2)) & 0xFF, (c1 >> (8 * 2)) & 0xFF, u),
+                                     lerpf((c0 >> (8 * 1)) & 0xFF, (c1 >> (8 * 1)) & 0xFF, u),
+                                     lerpf((c0 >> (8 * 0)) & 0xFF, (c1 >> (8 * 0)) & 0xFF, u));
+    }
+}
+
+// The color channels of the ball accumulated by the kernels for the shading
+// of the scene
+static void scene_update_channels(Scene *scene, size_t i)
+{
+    Pixel32 color = scene->colors[i];
+    switch (scene->shading) {
+    case SHADING_BLEND:
+    case SHADING_LIT:
+        scene->rs[i] = (float) ((color >> (8 * 2)) & 0xFF);
+        scene->gs[i] = (float) ((color >> (8 * 1)) & 0xFF);
+        scene->bs[i] = (float) ((color >> (8 * 0)) & 0xFF);
+        break;
+    case SHADING_LINEAR:
+        scene->rs[i] = srgb_to_linear_lut[(color >> (8 * 2)) & 0xFF];
+        scene->gs[i] = srgb_to_linear_lut[(color >> (8 * 1)) & 0xFF];
+        scene->bs[i] = srgb_to_linear_lut[(color >> (8 * 0)) & 0xFF];
+        break;
+    case SHADING_PALETTE:
+        scene->rs[i] = (float) i;
+        scene->gs[i] = 0.0f;
+        scene->bs[i] = 0.0f;
+        break;
+    default:
+        assert(0 && "unreachable");
+    }
+}
+
+#define SCENE_BALL_ARRAYS(X) \
+    X(xs) X(ys) X(strengths) X(radii) X(inv_radii2) X(rs) X(gs) X(bs) \
+    X(xqs) X(yqs) X(strengths_q) X(strengths_shift) X(colors) X(rbs) X(g1s) X(statics)
+
+// Every array starts on its own cache line
+#define SCENE_ARRAY_ALIGN 64
+
+static inline size_t scene_array_size(size_t capacity, size_t item)
+{
+    return (capacity * item + SCENE_ARRAY_ALIGN - 1) / SCENE_ARRAY_ALIGN * SCENE_ARRAY_ALIGN;
+}
+
+// Makes room for at least capacity balls keeping the existing ones
+void scene_reserve(Scene *scene, size_t capacity)
+{
+    if (capacity <= scene->capacity) return;
+    assert(capacity <= SCENE_BALLS_CAP);
+    if (capacity < 2*scene->capacity) capacity = 2*scene->capacity;
+    if (capacity < 16) capacity = 16;
+    if (capacity > SCENE_BALLS_CAP) capacity = SCENE_BALLS_CAP;
+
+    size_t size = 0;
+#define X(array) size += scene_array_size(capacity, sizeof(*scene->array));
+    SCENE_BALL_ARRAYS(X)
+#undef X
+    char *storage = malloc(size);
+    if (storage == NULL) {
+        fprintf(stderr, "ERROR: could not allocate memory for the balls: %s\n",
+                strerror(errno));
+        exit(1);
+    }
+
+    size_t offset = 0;
+#define X(array) \
+    if (scene->count > 0) memcpy(storage + offset, scene->array, scene->count * sizeof(*scene->array)); \
+    scene->array = (void*) (storage + offset); \
+    offset += scene_array_size(capacity, sizeof(*scene->array));
+    SCENE_BALL_ARRAYS(X)
+#undef X
+
+    free(scene->storage);
+    scene->storage = storage;
+    scene->capacity = capacity;
+}
+
+void scene_free(Scene *scene)
+{
+    free(scene->storage);
+#define X(array) scene->array = NULL;
+    SCENE_BALL_ARRAYS(X)
+#undef X
+    scene->storage = NULL;
+    scene->capacity = 0;
+    scene->count = 0;
+}
+
+// Grows the array of *count scenes to at least wanted, the new ones are empty
+void scenes_grow(Scene **scenes, size_t *count, size_t wanted)
+{
+    if (wanted <= *count) return;
+    Scene *grown = realloc(*scenes, wanted * sizeof(**scenes));
+    if (grown == NULL) {
+        fprintf(stderr, "ERROR: could not allocate memory for the scenes: %s\n",
+                strerror(errno));
+        exit(1);
+    }
+    memset(&grown[*count], 0, (wanted - *count) * sizeof(**scenes));
+    *scenes = grown;
+    *count = wanted;
+}
+
+void scenes_free(Scene **scenes, size_t *count)
+{
+    for (size_t i = 0; i < *count; ++i) {
+        scene_free(&(*scenes)[i]);
+    }
+    free(*scenes);
+    *scenes = NULL;
+    *count = 0;
+}
+
+void scene_clear(Scene *scene, Pixel32 background)
+{
+    scene->count = 0;
+    scene->negatives = 0;
+    scene->statics_version += 1;
+    scene->background = background;
+}
+
+static inline int32_t fixed_pos(float x)
+{
+    return (int32_t) lroundf(x * (1 << FIXED_POS_BITS));
+}
+
+static inline void fixed_strength(float strength, int32_t *q, uint8_t *shift)
+{
+    // |strength| < 2^e
+    int e;
+    frexpf(strength, &e);
+    int s = FIXED_STRENGTH_BITS - e;
+    // Beyond the strengths anybody uses on either end
+    if (s < 0) s = 0;
+    if (s > 62) s = 62;
+    *q = (int32_t) lroundf(ldexpf(strength, s));
+    *shift = (uint8_t) s;
+}
+
+size_t scene_push_ball(Scene *scene, V2f pos, float strength, Pixel32 color)
+{
+    assert(scene->count < SCENE_BALLS_CAP);
+    scene_reserve(scene, scene->count + 1);
+    size_t i = scene->count++;
+    scene->xs[i] = pos.x;
+    scene->ys[i] = pos.y;
+    scene->strengths[i] = strength;
+    scene->negatives += strength < 0.0f;
+    // By default the compact falloffs reach as far as the 1/r one reaches the
+    // threshold, which is as far for the negative balls
+    scene->radii[i] = fabsf(strength) / FIELD_THRESHOLD;
+    scene->inv_radii2[i] = 1.0f / (scene->radii[i] * scene->radii[i]);
+    scene->xqs[i] = fixed_pos(pos.x);
+    scene->yqs[i] = fixed_pos(pos.y);
+    fixed_strength(strength, &scene->strengths_q[i], &scene->strengths_shift[i]);
+    scene->colors[i] = color;
+    scene_update_channels(scene, i);
+    if (scene->shading == SHADING_PALETTE) scene_build_palette(scene);
+    scene->rbs[i] = ((uint64_t) ((color >> (8 * 2)) & 0xFF) << 32) | ((color >> (8 * 0)) & 0xFF);
+    scene->g1s[i] = ((uint64_t) ((color >> (8 * 1)) & 0xFF) << 32) | 1;
+    scene->statics[i] = false;
+    return i;
+}
+
+void scene_set_static(Scene *scene, size_t i, bool is_static)
+{
+    assert(i < scene->count);
+    if (scene->statics[i] != is_static) {
+        scene->statics[i] = is_static;
+        scene->statics_version += 1;
+    }
+}
+
+void scene_set_radius(Scene *scene, size_t i, float radius)
+{
+    assert(i < scene->count);
+    assert(radius > 0.0f);
+    if (scene->statics[i] && scene->radii[i] != radius) {
+        scene->statics_version += 1;
+    }
+    scene->radii[i] = radius;
+    scene->inv_radii2[i] = 1.0f / (radius * radius);
+}
+
+void scene_set_falloff(Scene *scene, Falloff falloff)
+{
+    assert(falloff < COUNT_FALLOFFS);
+    if (scene->falloff != falloff) {
+        scene->falloff = falloff;
+        scene->statics_version += 1;
+    }
+}
+
+void scene_set_shading(Scene *scene, Shading shading)
+{
+    assert(shading < COUNT_SHADINGS);
+    if (scene->shading != shading) {
+        scene->shading = shading;
+        for (size_t i = 0; i < scene->count; ++i) {
+            scene_update_channels(scene, i);
+        }
+        if (shading == SHADING_PALETTE) scene_build_palette(scene);
+        scene->statics_version += 1;
+    }
+}
+
+// Everything but the balls
+static void scene_copy_header(const Scene *src, Scene *dst)
+{
+    dst->statics_version = 0;
+    dst->negatives = src->negatives;
+    dst->falloff = src->falloff;
+    dst->shading = src->shading;
+    dst->background = src->background;
+    if (src->shading == SHADING_PALETTE) {
+        memcpy(dst->palette, src->palette, sizeof(dst->palette));
+        dst->palette_scale = src->palette_scale;
+    }
+}
+
+void scene_move_ball(Scene *scene, size_t i, V2f pos)
+{
+    assert(i < scene->count);
+    if (scene->statics[i] && (scene->xs[i] != pos.x || scene->ys[i] != pos.y)) {
+        scene->statics_version += 1;
+    }
+    scene->xs[i] = pos.x;
+    scene->ys[i] = pos.y;
+    scene->xqs[i] = fixed_pos(pos.x);
+    scene->yqs[i] = fixed_pos(pos.y);
+}
+
+static inline void scene_copy_ball(const Scene *src, size_t i, Scene *dst, size_t j)
+{
+    dst->xs[j] = src->xs[i];
+    dst->ys[j] = src->ys[i];
+    dst->strengths[j] = src->strengths[i];
+    dst->radii[j] = src->radii[i];
+    dst->inv_radii2[j] = src->inv_radii2[i];
+    dst->rs[j] = src->rs[i];
+    dst->gs[j] = src->gs[i];
+    dst->bs[j] = src->bs[i];
+    dst->xqs[j] = src->xqs[i];
+    dst->yqs[j] = src->yqs[i];
+    dst->strengths_q[j] = src->strengths_q[i];
+    dst->strengths_shift[j] = src->strengths_shift[i];
+    dst->colors[j] = src->colors[i];
+    dst->rbs[j] = src->rbs[i];
+    dst->g1s[j] = src->g1s[i];
+    dst->statics[j] = src->statics[i];
+}
+
+// Copies the balls of src that are not static into dst
+void scene_copy_dynamic(const Scene *src, Scene *dst)
+{
+    size_t count = 0;
+    for (size_t i = 0; i < src->count; ++i) {
+        count += !src->statics[i];
+    }
+    dst->count = 0;
+    scene_reserve(dst, count);
+    scene_copy_header(src, dst);
+    for (size_t i = 0; i < src->count; ++i) {
+        if (src->statics[i]) continue;
+        scene_copy_ball(src, i, dst, dst->count++);
+    }
+}
+
+// Copies the balls of src at the indices into dst in the same order
+void scene_copy_subset(const Scene *src, const uint32_t *indices, size_t count, Scene *dst)
+{
+    dst->count = 0;
+    scene_reserve(dst, count);
+    dst->count = count;
+    scene_copy_header(src, dst);
+    for (size_t j = 0; j < count; ++j) {
+        scene_copy_ball(src, indices[j], dst, j);
+    }
+}
+
+// Renders the rectangle [x0, x1)x[y0, y1) of the frame. pixels always points
+// at the beginning of the whole frame which is stride pixels wide. If base is
+// not NULL the field of the balls of the scene is added on top of it.
+//
+// Always inlined, so every scalar kernel built on top of it gets its own copy
+// with the falloff inlined as well.
+static ALWAYS_INLINE void render_region_with(const Scene *scene, const Field *base,
+                                             Pixel32 *pixels, size_t stride,
+                                             size_t x0, size_t y0, size_t x1, size_t y1,
+                                             Falloff_Func f)
+{
+    for (size_t y = y0; y < y1; ++y) {
+        float py = (float) y + 0.5f;
+        for (size_t x = x0; x < x1; ++x) {
+            float px = (float) x + 0.5f;
+
+            // Every ball contributes its color proportionally to its field value
+            float s = 0.0f, r = 0.0f, g = 0.0f, b = 0.0f;
+            if (base) {
+                s = base->s[y*stride + x];
+                r = base->r[y*stride + x];
+                g = base->g[y*stride + x];
+                b = base->b[y*stride + x];
+            }
+            for (size_t i = 0; i < scene->count; ++i) {
+                float dx = scene->xs[i] - px;
+                float dy = scene->ys[i] - py;
+                float si = scene->strengths[i] * f(dx*dx + dy*dy, scene->inv_radii2[i]);
+                s += si;
+                r += si * scene->rs[i];
+                g += si * scene->gs[i];
+                b += si * scene->bs[i];
+            }
+
+            pixels[y*stride + x] = resolve_pixel(scene, s, r, g, b);
+        }
+    }
+}
+
+// render_region_with() for SHADING_LIT. Along with the colors every ball adds
+// its share of the gradient of the field, which is the derivative of the
+// falloff times the offset to the ball (see falloff_slope()). The derivative
+// reuses the value of the falloff, so for the 1/r falloffs it's just 1/r^3 from
+// the 1/r already computed and the lighting costs a few multiplies per ball.
+static ALWAYS_INLINE void render_region_lit_with(const Scene *scene, const Field *base,
+                                                 Pixel32 *pixels, size_t stride,
+                                                 size_t x0, size_t y0, size_t x1, size_t y1,
+                                                 Falloff falloff, Falloff_Func f)
+{
+    for (size_t y = y0; y < y1; ++y) {
+        float py = (float) y + 0.5f;
+        for (size_t x = x0; x < x1; ++x) {
+            float px = (float) x + 0.5f;
+
+            float s = 0.0f, r = 0.0f, g = 0.0f, b = 0.0f, gx = 0.0f, gy = 0.0f;
+            if (base) {
+                s = base->s[y*stride + x];
+                r = base->r[y*stride + x];
+                g = base->g[y*stride + x];
+                b = base->b[y*stride + x];
+                gx = base->gx[y*stride + x];
+                gy = base->gy[y*stride + x];
+            }
+            for (size_t i = 0; i < scene->count; ++i) {
+                float dx = scene->xs[i] - px;
+                float dy = scene->ys[i] - py;
+                float d2 = dx*dx + dy*dy;
+                float strength = scene->strengths[i];
+                float fi = f(d2, scene->inv_radii2[i]);
+                float si = strength * fi;
+                float ki = strength * falloff_slope(falloff, fi, d2, scene->inv_radii2[i]);
+                s += si;
+                r += si * scene->rs[i];
+                g += si * scene->gs[i];
+                b += si * scene->bs[i];
+                gx += ki * dx;
+                gy += ki * dy;
+            }
+
+            pixels[y*stride + x] = resolve_pixel_lit(scene, s, r, g, b, gx, gy);
+        }
+    }
+}
+
+static void render_region_lit(const Scene *scene, const Field *base,
+                              Pixel32 *pixels, size_t stride,
+                              size_t x0, size_t y0, size_t x1, size_t y1)
+{
+    switch (scene->falloff) {
+    case FALLOFF_INVERSE:
+        render_region_lit_with(scene, base, pixels, stride, x0, y0, x1, y1, FALLOFF_INVERSE, falloff_inverse);
+        break;
+    case FALLOFF_INVERSE_Q2:
+        render_region_lit_with(scene, base, pixels, stride, x0, y0, x1, y1, FALLOFF_INVERSE_Q2, falloff_inverse_q2);
+        break;
+    case FALLOFF_INVERSE_SQRTF:
+        render_region_lit_with(scene, base, pixels, stride, x0, y0, x1, y1, FALLOFF_INVERSE_SQRTF, falloff_inverse_sqrtf);
+        break;
+    case FALLOFF_INVERSE4:
+        render_region_lit_with(scene, base, pixels, stride, x0, y0, x1, y1, FALLOFF_INVERSE4, falloff_inverse4);
+        break;
+    case FALLOFF_WYVILL:
+        render_region_lit_with(scene, base, pixels, stride, x0, y0, x1, y1, FALLOFF_WYVILL, falloff_wyvill);
+        break;
+    case FALLOFF_MURAKAMI:
+        render_region_lit_with(scene, base, pixels, stride, x0, y0, x1, y1, FALLOFF_MURAKAMI, falloff_murakami);
+        break;
+    default:
+        assert(0 && "unreachable");
+    }
+}
+
+static void render_region(const Scene *scene, const Field *base,
+                          Pixel32 *pixels, size_t stride,
+                          size_t x0, size_t y0, size_t x1, size_t y1)
+{
+    if (scene->shading == SHADING_LIT) {
+        render_region_lit(scene, base, pixels, stride, x0, y0, x1, y1);
+        return;
+    }
+
+    switch (scene->falloff) {
+    case FALLOFF_INVERSE:
+        render_region_with(scene, base, pixels, stride, x0, y0, x1, y1, falloff_inverse);
+        break;
+    case FALLOFF_INVERSE_Q2:
+        render_region_with(scene, base, pixels, stride, x0, y0, x1, y1, falloff_inverse_q2);
+        break;
+    case FALLOFF_INVERSE_SQRTF:
+        render_region_with(scene, base, pixels, stride, x0, y0, x1, y1, falloff_inverse_sqrtf);
+        break;
+    case FALLOFF_INVERSE4:
+        render_region_with(scene, base, pixels, stride, x0, y0, x1, y1, falloff_inverse4);
+        break;
+    case FALLOFF_WYVILL:
+        render_region_with(scene, base, pixels, stride, x0, y0, x1, y1, falloff_wyvill);
+        break;
+    case FALLOFF_MURAKAMI:
+        render_region_with(scene, base, pixels, stride, x0, y0, x1, y1, falloff_murakami);
+        break;
+    default:
+        assert(0 && "unreachable");
+    }
+}
+
+static ALWAYS_INLINE void accumulate_field_with(const Scene *scene, bool statics,
+                                                const Field *field, size_t stride,
+                                                size_t x0, size_t y0, size_t x1, size_t y1,
+                                                Falloff falloff, Falloff_Func f)
+{
+    bool lit = scene->shading == SHADING_LIT;
+    for (size_t y = y0; y < y1; ++y) {
+        float py = (float) y + 0.5f;
+        for (size_t x = x0; x < x1; ++x) {
+            float px = (float) x + 0.5f;
+
+            float s = 0.0f, r = 0.0f, g = 0.0f, b = 0.0f, gx = 0.0f, gy = 0.0f;
+            for (size_t i = 0; i < scene->count; ++i) {
+                if (scene->statics[i] != statics) continue;
+                float dx = scene->xs[i] - px;
+                float dy = scene->ys[i] - py;
+                float d2 = dx*dx + dy*dy;
+                float fi = f(d2, scene->inv_radii2[i]);
+                float si = scene->strengths[i] * fi;
+                s += si;
+                r += si * scene->rs[i];
+                g += si * scene->gs[i];
+                b += si * scene->bs[i];
+                if (lit) {
+                    float ki = scene->strengths[i] * falloff_slope(falloff, fi, d2, scene->inv_radii2[i]);
+                    gx += ki * dx;
+                    gy += ki * dy;
+                }
+            }
+
+            field->s[y*stride + x] = s;
+            field->r[y*stride + x] = r;
+            field->g[y*stride + x] = g;
+            field->b[y*stride + x] = b;
+            if (lit) {
+                field->gx[y*stride + x] = gx;
+                field->gy[y*stride + x] = gy;
+            }
+        }
+    }
+}
+
+// Accumulates the field of the balls of the scene for which
+// scene->statics[i] == statics into the rectangle [x0, x1)x[y0, y1) of field
+void accumulate_field(const Scene *scene, bool statics, const Field *field, size_t stride,
+                      size_t x0, size_t y0, size_t x1, size_t y1)
+{
+    switch (scene->falloff) {
+    case FALLOFF_INVERSE:
+        accumulate_field_with(scene, statics, field, stride, x0, y0, x1, y1, FALLOFF_INVERSE, falloff_inverse);
+        break;
+    case FALLOFF_INVERSE_Q2:
+        accumulate_field_with(scene, statics, field, stride, x0, y0, x1, y1, FALLOFF_INVERSE_Q2, falloff_inverse_q2);
+        break;
+    case FALLOFF_INVERSE_SQRTF:
+        accumulate_field_with(scene, statics, field, stride, x0, y0, x1, y1, FALLOFF_INVERSE_SQRTF, falloff_inverse_sqrtf);
+        break;
+    case FALLOFF_INVERSE4:
+        accumulate_field_with(scene, statics, field, stride, x0, y0, x1, y1, FALLOFF_INVERSE4, falloff_inverse4);
+        break;
+    case FALLOFF_WYVILL:
+        accumulate_field_with(scene, statics, field, stride, x0, y0, x1, y1, FALLOFF_WYVILL, falloff_wyvill);
+        break;
+    case FALLOFF_MURAKAMI:
+        accumulate_field_with(scene, statics, field, stride, x0, y0, x1, y1, FALLOFF_MURAKAMI, falloff_murakami);
+        break;
+    default:
+        assert(0 && "unreachable");
+    }
+}
@@ -0,0 +1,59 @@
+// Backend publishing the frames into a ring in POSIX shared memory (see
+// ring.h) for the other processes on the host to map, like ringcat. Like the
+// headless backend the moving ball follows the script of scripted_ball_pos(),
+// and the frames come at STREAM_FPS whether anybody looks at them or not.
+#include <time.h>
+
+// The consumers have this many frames of time to look at a frame before it's
+// overwritten
+#define SHM_SLOTS 3
+#define SHM_NAME "/metaballs"
+
+void shm_run(size_t frames)
+{
+    if (frames == 0) frames = HEADLESS_FRAMES;
+
+    const char *name = strcmp(output_path, "-") == 0 ? SHM_NAME : output_path;
+    Ring ring;
+    if (!ring_create(&ring, name, WIDTH, HEIGHT, SHM_SLOTS)) exit(1);
+    fprintf(stderr, "INFO: publishing the frames to the shared memory %s\n", name);
+
+    struct timespec deadline;
+    if (clock_gettime(CLOCK_MONOTONIC, &deadline) < 0) {
+        fprintf(stderr, "ERROR: could not get current monotonic time: %s\n",
+                strerror(errno));
+        exit(1);
+    }
+
+    clear_totals();
+    double begin = headless_now();
+    for (size_t frame = 0; frame < frames; ++frame) {
+        scene_move_ball(&scene, moving_ball, scripted_ball_pos(frame));
+
+        clear_summary();
+        begin_clock("TOTAL");
+        {
+            // Straight into the shared memory
+            pixels = ring_begin_frame(&ring);
+            render_frame();
+            ring_end_frame(&ring);
+        }
+        end_clock();
+        accumulate_summary();
+
+        deadline.tv_nsec += 1000000000 / STREAM_FPS;
+        if (deadline.tv_nsec >= 1000000000) {
+            deadline.tv_sec += 1;
+            deadline.tv_nsec -= 1000000000;
+        }
+        while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &deadline, NULL) == EINTR);
+    }
+    double elapsed = headless_now() - begin;
+    ring_destroy(&ring);
+    pixels = NULL;
+
+    printf("Frames: %zu of %dx%d in %.3lf secs, %.2lf FPS\n",
+           frames, WIDTH, HEIGHT, elapsed, frames / elapsed);
+    printf("Average per frame:\n");
+    dump_totals(stdout);
+}
@@ -0,0 +1,548 @@
+// Vectorized versions of render_region() from scene.c. Every kernel
+// evaluates 4, 8 or 16 horizontally adjacent pixels at once and falls back to
+// render_region() for the columns that do not fill a whole vector.
+//
+// Every kernel is written once as an always inlined render_region_*_with()
+// and instantiated for every falloff.
+//
+// The inverse and inverse-q2 falloffs use the hardware reciprocal square root
+// refined with one and two Newton-Raphson steps instead of Q_rsqrt(). The
+// relative error of one step (~1e-6) is already well below the one of
+// Q_rsqrt() with a single iteration (~2e-3), so the output differs from the
+// scalar kernel by at most 1 per color channel, and pixels may flip between
+// background and foreground only where the scalar field is within 0.2% of
+// FIELD_THRESHOLD. The inverse-sqrtf and inverse4 falloffs are computed with
+// the IEEE square root and division, exactly like the scalar kernel.
+//
+// Every shading is resolved in the vectors as well: AVX2 and AVX-512 look up
+// the palette and the sRGB table with gathers, SSE2 has none and resolves
+// everything but blend one pixel at a time.
+//
+// The kernels are compiled with per-function target attributes so the whole
+// program can still be built for the baseline x86-64 and pick the widest
+// kernel the CPU supports at runtime (see kernels.c).
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define SIMD_X86
+#include <immintrin.h>
+
+__attribute__((target("sse2")))
+static inline __m128 rsqrt_newton_sse2(__m128 d2, __m128 y)
+{
+    __m128 x2 = _mm_mul_ps(d2, _mm_set1_ps(0.5f));
+    return _mm_mul_ps(y, _mm_sub_ps(_mm_set1_ps(1.5f), _mm_mul_ps(x2, _mm_mul_ps(y, y))));
+}
+
+__attribute__((target("sse2")))
+static inline __m128 falloff_inverse_sse2(__m128 d2, __m128 inv_r2)
+{
+    (void) inv_r2;
+    return rsqrt_newton_sse2(d2, _mm_rsqrt_ps(d2));
+}
+
+__attribute__((target("sse2")))
+static inline __m128 falloff_inverse_q2_sse2(__m128 d2, __m128 inv_r2)
+{
+    (void) inv_r2;
+    return rsqrt_newton_sse2(d2, rsqrt_newton_sse2(d2, _mm_rsqrt_ps(d2)));
+}
+
+__attribute__((target("sse2")))
+static inline __m128 falloff_inverse_sqrtf_sse2(__m128 d2, __m128 inv_r2)
+{
+    (void) inv_r2;
+    return _mm_div_ps(_mm_set1_ps(1.0f), _mm_sqrt_ps(d2));
+}
+
+__attribute__((target("sse2")))
+static inline __m128 falloff_inverse4_sse2(__m128 d2, __m128 inv_r2)
+{
+    (void) inv_r2;
+    __m128 s = _mm_div_ps(_mm_set1_ps(1.0f), d2);
+    return _mm_mul_ps(s, s);
+}
+
+__attribute__((target("sse2")))
+static inline __m128 falloff_wyvill_sse2(__m128 d2, __m128 inv_r2)
+{
+    __m128 q = _mm_mul_ps(d2, inv_r2);
+    __m128 f = _mm_sub_ps(_mm_set1_ps(17.0f/9.0f), _mm_mul_ps(q, _mm_set1_ps(4.0f/9.0f)));
+    f = _mm_add_ps(_mm_set1_ps(-22.0f/9.0f), _mm_mul_ps(q, f));
+    f = _mm_add_ps(_mm_set1_ps(1.0f), _mm_mul_ps(q, f));
+    return _mm_and_ps(f, _mm_cmplt_ps(q, _mm_set1_ps(1.0f)));
+}
+
+__attribute__((target("sse2")))
+static inline __m128 falloff_murakami_sse2(__m128 d2, __m128 inv_r2)
+{
+    __m128 t = _mm_max_ps(_mm_sub_ps(_mm_set1_ps(1.0f), _mm_mul_ps(d2, inv_r2)), _mm_setzero_ps());
+    return _mm_mul_ps(t, t);
+}
+
+// clamp_channel(c, 255.0f) for 4 channels. Unlike the scalar one it costs
+// next to nothing, so it doesn't wait for the negative balls. maxps returns
+// the second operand for a NaN, so the NaNs go to 0 just the same.
+__attribute__((target("sse2")))
+static inline __m128 clamp_channel_sse2(__m128 c)
+{
+    return _mm_min_ps(_mm_max_ps(c, _mm_setzero_ps()), _mm_set1_ps(255.0f));
+}
+
+// resolve_pixel() for 4 pixels. SSE2 has no gathers, so only the blend
+// shading is vectorized and the others are resolved one pixel at a time.
+__attribute__((target("sse2")))
+static inline __m128i resolve_sse2(const Scene *scene, __m128 s, __m128 r, __m128 g, __m128 b)
+{
+    if (scene->shading != SHADING_BLEND) {
+        float ss[4], rs[4], gs[4], bs[4];
+        Pixel32 result[4];
+        _mm_storeu_ps(ss, s);
+        _mm_storeu_ps(rs, r);
+        _mm_storeu_ps(gs, g);
+        _mm_storeu_ps(bs, b);
+        for (size_t i = 0; i < 4; ++i) {
+            result[i] = resolve_pixel(scene, ss[i], rs[i], gs[i], bs[i]);
+        }
+        return _mm_loadu_si128((const __m128i*) result);
+    }
+
+    __m128 inv = _mm_div_ps(_mm_set1_ps(1.0f), s);
+    __m128i ri = _mm_cvttps_epi32(clamp_channel_sse2(_mm_mul_ps(r, inv)));
+    __m128i gi = _mm_cvttps_epi32(clamp_channel_sse2(_mm_mul_ps(g, inv)));
+    __m128i bi = _mm_cvttps_epi32(clamp_channel_sse2(_mm_mul_ps(b, inv)));
+    __m128i color = _mm_or_si128(_mm_or_si128(_mm_slli_epi32(ri, 8 * 2),
+                                              _mm_slli_epi32(gi, 8 * 1)),
+                                 bi);
+
+    __m128i mask = _mm_castps_si128(_mm_cmpge_ps(s, _mm_set1_ps(FIELD_THRESHOLD)));
+    __m128i background = _mm_set1_epi32((int) scene->background);
+    return _mm_or_si128(_mm_and_si128(mask, color), _mm_andnot_si128(mask, background));
+}
+
+__attribute__((target("sse2")))
+static ALWAYS_INLINE void render_region_sse2_with(const Scene *scene, const Field *base,
+                                                  Pixel32 *pixels, size_t stride,
+                                                  size_t x0, size_t y0, size_t x1, size_t y1,
+                                                  __m128 (*f)(__m128 d2, __m128 inv_r2))
+{
+    const __m128 lanes = _mm_setr_ps(0.5f, 1.5f, 2.5f, 3.5f);
+
+    for (size_t y = y0; y < y1; ++y) {
+        float py = (float) y + 0.5f;
+        size_t x = x0;
+        for (; x + 4 <= x1; x += 4) {
+            __m128 px = _mm_add_ps(_mm_set1_ps((float) x), lanes);
+
+            __m128 s = _mm_setzero_ps(), r = s, g = s, b = s;
+            if (base) {
+                s = _mm_loadu_ps(&base->s[y*stride + x]);
+                r = _mm_loadu_ps(&base->r[y*stride + x]);
+                g = _mm_loadu_ps(&base->g[y*stride + x]);
+                b = _mm_loadu_ps(&base->b[y*stride + x]);
+            }
+            for (size_t i = 0; i < scene->count; ++i) {
+                float dy = scene->ys[i] - py;
+                __m128 dx = _mm_sub_ps(_mm_set1_ps(scene->xs[i]), px);
+                __m128 d2 = _mm_add_ps(_mm_mul_ps(dx, dx), _mm_set1_ps(dy*dy));
+                __m128 si = _mm_mul_ps(_mm_set1_ps(scene->strengths[i]), f(d2, _mm_set1_ps(scene->inv_radii2[i])));
+                s = _mm_add_ps(s, si);
+                r = _mm_add_ps(r, _mm_mul_ps(si, _mm_set1_ps(scene->rs[i])));
+                g = _mm_add_ps(g, _mm_mul_ps(si, _mm_set1_ps(scene->gs[i])));
+                b = _mm_add_ps(b, _mm_mul_ps(si, _mm_set1_ps(scene->bs[i])));
+            }
+
+            _mm_storeu_si128((__m128i*) &pixels[y*stride + x], resolve_sse2(scene, s, r, g, b));
+        }
+
+        if (x < x1) {
+            render_region(scene, base, pixels, stride, x, y, x1, y + 1);
+        }
+    }
+}
+
+__attribute__((target("sse2")))
+static void render_region_sse2(const Scene *scene, const Field *base,
+                               Pixel32 *pixels, size_t stride,
+                               size_t x0, size_t y0, size_t x1, size_t y1)
+{
+    switch (scene->falloff) {
+    case FALLOFF_INVERSE:
+        render_region_sse2_with(scene, base, pixels, stride, x0, y0, x1, y1, falloff_inverse_sse2);
+        break;
+    case FALLOFF_INVERSE_Q2:
+        render_region_sse2_with(scene, base, pixels, stride, x0, y0, x1, y1, falloff_inverse_q2_sse2);
+        break;
+    case FALLOFF_INVERSE_SQRTF:
+        render_region_sse2_with(scene, base, pixels, stride, x0, y0, x1, y1, falloff_inverse_sqrtf_sse2);
+        break;
+    case FALLOFF_INVERSE4:
+        render_region_sse2_with(scene, base, pixels, stride, x0, y0, x1, y1, falloff_inverse4_sse2);
+        break;
+    case FALLOFF_WYVILL:
+        render_region_sse2_with(scene, base, pixels, stride, x0, y0, x1, y1, falloff_wyvill_sse2);
+        break;
+    case FALLOFF_MURAKAMI:
+        render_region_sse2_with(scene, base, pixels, stride, x0, y0, x1, y1, falloff_murakami_sse2);
+        break;
+    default:
+        assert(0 && "unreachable");
+    }
+}
+
+__attribute__((target("avx2")))
+static inline __m256 rsqrt_newton_avx2(__m256 d2, __m256 y)
+{
+    __m256 x2 = _mm256_mul_ps(d2, _mm256_set1_ps(0.5f));
+    return _mm256_mul_ps(y, _mm256_sub_ps(_mm256_set1_ps(1.5f), _mm256_mul_ps(x2, _mm256_mul_ps(y, y))));
+}
+
+__attribute__((target("avx2")))
+static inline __m256 falloff_inverse_avx2(__m256 d2, __m256 inv_r2)
+{
+    (void) inv_r2;
+    return rsqrt_newton_avx2(d2, _mm256_rsqrt_ps(d2));
+}
+
+__attribute__((target("avx2")))
+static inline __m256 falloff_inverse_q2_avx2(__m256 d2, __m256 inv_r2)
+{
+    (void) inv_r2;
+    return rsqrt_newton_avx2(d2, rsqrt_newton_avx2(d2, _mm256_rsqrt_ps(d2)));
+}
+
+__attribute__((target("avx2")))
+static inline __m256 falloff_inverse_sqrtf_avx2(__m256 d2, __m256 inv_r2)
+{
+    (void) inv_r2;
+    return _mm256_div_ps(_mm256_set1_ps(1.0f), _mm256_sqrt_ps(d2));
+}
+
+__attribute__((target("avx2")))
+static inline __m256 falloff_inverse4_avx2(__m256 d2, __m256 inv_r2)
+{
+    (void) inv_r2;
+    __m256 s = _mm256_div_ps(_mm256_set1_ps(1.0f), d2);
+    return _mm256_mul_ps(s, s);
+}
+
+__attribute__((target("avx2")))
+static inline __m256 falloff_wyvill_avx2(__m256 d2, __m256 inv_r2)
+{
+    __m256 q = _mm256_mul_ps(d2, inv_r2);
+    __m256 f = _mm256_sub_ps(_mm256_set1_ps(17.0f/9.0f), _mm256_mul_ps(q, _mm256_set1_ps(4.0f/9.0f)));
+    f = _mm256_add_ps(_mm256_set1_ps(-22.0f/9.0f), _mm256_mul_ps(q, f));
+    f = _mm256_add_ps(_mm256_set1_ps(1.0f), _mm256_mul_ps(q, f));
+    return _mm256_and_ps(f, _mm256_cmp_ps(q, _mm256_set1_ps(1.0f), _CMP_LT_OQ));
+}
+
+__attribute__((target("avx2")))
+static inline __m256 falloff_murakami_avx2(__m256 d2, __m256 inv_r2)
+{
+    __m256 t = _mm256_max_ps(_mm256_sub_ps(_mm256_set1_ps(1.0f), _mm256_mul_ps(d2, inv_r2)), _mm256_setzero_ps());
+    return _mm256_mul_ps(t, t);
+}
+
+// clamp_channel() for 8 channels, see clamp_channel_sse2()
+__attribute__((target("avx2")))
+static inline __m256 clamp_channel_avx2(__m256 c)
+{
+    return _mm256_min_ps(_mm256_max_ps(c, _mm256_setzero_ps()), _mm256_set1_ps(255.0f));
+}
+
+// linear_to_srgb() for 8 channels scaled to the indices into the table,
+// clamped like clamp_channel() does
+__attribute__((target("avx2")))
+static inline __m256i linear_to_srgb_avx2(__m256 t)
+{
+    t = _mm256_min_ps(_mm256_max_ps(t, _mm256_setzero_ps()), _mm256_set1_ps(SRGB_LUT_SIZE - 1));
+    __m256i index = _mm256_cvttps_epi32(t);
+    return _mm256_and_si256(_mm256_i32gather_epi32((const int*) linear_to_srgb_lut, index, 1),
+                            _mm256_set1_epi32(0xFF));
+}
+
+// resolve_pixel() for 8 pixels, with the lookups of every shading done with
+// gathers
+__attribute__((target("avx2")))
+static inline __m256i resolve_avx2(const Scene *scene, __m256 s, __m256 r, __m256 g, __m256 b)
+{
+    __m256 inv = _mm256_div_ps(_mm256_set1_ps(1.0f), s);
+    __m256i color;
+    switch (scene->shading) {
+    case SHADING_BLEND: {
+        __m256i ri = _mm256_cvttps_epi32(clamp_channel_avx2(_mm256_mul_ps(r, inv)));
+        __m256i gi = _mm256_cvttps_epi32(clamp_channel_avx2(_mm256_mul_ps(g, inv)));
+        __m256i bi = _mm256_cvttps_epi32(clamp_channel_avx2(_mm256_mul_ps(b, inv)));
+        color = _mm256_or_si256(_mm256_or_si256(_mm256_slli_epi32(ri, 8 * 2),
+                                                _mm256_slli_epi32(gi, 8 * 1)),
+                                bi);
+    } break;
+    case SHADING_PALETTE: {
+        __m256 t = _mm256_add_ps(_mm256_mul_ps(_mm256_mul_ps(r, inv), _mm256_set1_ps(scene->palette_scale)),
+                                 _mm256_set1_ps(0.5f));
+        t = _mm256_min_ps(_mm256_max_ps(t, _mm256_setzero_ps()), _mm256_set1_ps(PALETTE_SIZE - 1));
+        color = _mm256_i32gather_epi32((const int*) scene->palette, _mm256_cvttps_epi32(t), sizeof(Pixel32));
+    } break;
+    case SHADING_LINEAR: {
+        inv = _mm256_mul_ps(inv, _mm256_set1_ps(SRGB_LUT_SIZE - 1));
+        color = _mm256_or_si256(_mm256_or_si256(_mm256_slli_epi32(linear_to_srgb_avx2(_mm256_mul_ps(r, inv)), 8 * 2),
+                                                _mm256_slli_epi32(linear_to_srgb_avx2(_mm256_mul_ps(g, inv)), 8 * 1)),
+                                linear_to_srgb_avx2(_mm256_mul_ps(b, inv)));
+    } break;
+    default:
+        assert(0 && "unreachable");
+        color = _mm256_setzero_si256();
+    }
+
+    __m256 mask = _mm256_cmp_ps(s, _mm256_set1_ps(FIELD_THRESHOLD), _CMP_GE_OQ);
+    __m256i background = _mm256_set1_epi32((int) scene->background);
+    return _mm256_castps_si256(_mm256_blendv_ps(_mm256_castsi256_ps(background),
+                                                _mm256_castsi256_ps(color),
+                                                mask));
+}
+
+__attribute__((target("avx2")))
+static ALWAYS_INLINE void render_region_avx2_with(const Scene *scene, const Field *base,
+                                                  Pixel32 *pixels, size_t stride,
+                                                  size_t x0, size_t y0, size_t x1, size_t y1,
+                                                  __m256 (*f)(__m256 d2, __m256 inv_r2))
+{
+    const __m256 lanes = _mm256_setr_ps(0.5f, 1.5f, 2.5f, 3.5f, 4.5f, 5.5f, 6.5f, 7.5f);
+
+    for (size_t y = y0; y < y1; ++y) {
+        float py = (float) y + 0.5f;
+        size_t x = x0;
+        for (; x + 8 <= x1; x += 8) {
+            __m256 px = _mm256_add_ps(_mm256_set1_ps((float) x), lanes);
+
+            __m256 s = _mm256_setzero_ps(), r = s, g = s, b = s;
+            if (base) {
+                s = _mm256_loadu_ps(&base->s[y*stride + x]);
+                r = _mm256_loadu_ps(&base->r[y*stride + x]);
+                g = _mm256_loadu_ps(&base->g[y*stride + x]);
+                b = _mm256_loadu_ps(&base->b[y*stride + x]);
+            }
+            for (size_t i = 0; i < scene->count; ++i) {
+                float dy = scene->ys[i] - py;
+                __m256 dx = _mm256_sub_ps(_mm256_set1_ps(scene->xs[i]), px);
+                __m256 d2 = _mm256_add_ps(_mm256_mul_ps(dx, dx), _mm256_set1_ps(dy*dy));
+                __m256 si = _mm256_mul_ps(_mm256_set1_ps(scene->strengths[i]), f(d2, _mm256_set1_ps(scene->inv_radii2[i])));
+                s = _mm256_add_ps(s, si);
+                r = _mm256_add_ps(r, _mm256_mul_ps(si, _mm256_set1_ps(scene->rs[i])));
+                g = _mm256_add_ps(g, _mm256_mul_ps(si, _mm256_set1_ps(scene->gs[i])));
+                b = _mm256_add_ps(b, _mm256_mul_ps(si, _mm256_set1_ps(scene->bs[i])));
+            }
+
+            _mm256_storeu_si256((__m256i*) &pixels[y*stride + x], resolve_avx2(scene, s, r, g, b));
+        }
+
+        if (x < x1) {
+            render_region_sse2(scene, base, pixels, stride, x, y, x1, y + 1);
+        }
+    }
+}
+
+__attribute__((target("avx2")))
+static void render_region_avx2(const Scene *scene, const Field *base,
+                               Pixel32 *pixels, size_t stride,
+                               size_t x0, size_t y0, size_t x1, size_t y1)
+{
+    switch (scene->falloff) {
+    case FALLOFF_INVERSE:
+        render_region_avx2_with(scene, base, pixels, stride, x0, y0, x1, y1, falloff_inverse_avx2);
+        break;
+    case FALLOFF_INVERSE_Q2:
+        render_region_avx2_with(scene, base, pixels, stride, x0, y0, x1, y1, falloff_inverse_q2_avx2);
+        break;
+    case FALLOFF_INVERSE_SQRTF:
+        render_region_avx2_with(scene, base, pixels, stride, x0, y0, x1, y1, falloff_inverse_sqrtf_avx2);
+        break;
+    case FALLOFF_INVERSE4:
+        render_region_avx2_with(scene, base, pixels, stride, x0, y0, x1, y1, falloff_inverse4_avx2);
+        break;
+    case FALLOFF_WYVILL:
+        render_region_avx2_with(scene, base, pixels, stride, x0, y0, x1, y1, falloff_wyvill_avx2);
+        break;
+    case FALLOFF_MURAKAMI:
+        render_region_avx2_with(scene, base, pixels, stride, x0, y0, x1, y1, falloff_murakami_avx2);
+        break;
+    default:
+        assert(0 && "unreachable");
+    }
+}
+
+__attribute__((target("avx512f")))
+static inline __m512 rsqrt_newton_avx512(__m512 d2, __m512 y)
+{
+    __m512 x2 = _mm512_mul_ps(d2, _mm512_set1_ps(0.5f));
+    return _mm512_mul_ps(y, _mm512_sub_ps(_mm512_set1_ps(1.5f), _mm512_mul_ps(x2, _mm512_mul_ps(y, y))));
+}
+
+__attribute__((target("avx512f")))
+static inline __m512 falloff_inverse_avx512(__m512 d2, __m512 inv_r2)
+{
+    (void) inv_r2;
+    return rsqrt_newton_avx512(d2, _mm512_rsqrt14_ps(d2));
+}
+
+__attribute__((target("avx512f")))
+static inline __m512 falloff_inverse_q2_avx512(__m512 d2, __m512 inv_r2)
+{
+    (void) inv_r2;
+    return rsqrt_newton_avx512(d2, rsqrt_newton_avx512(d2, _mm512_rsqrt14_ps(d2)));
+}
+
+__attribute__((target("avx512f")))
+static inline __m512 falloff_inverse_sqrtf_avx512(__m512 d2, __m512 inv_r2)
+{
+    (void) inv_r2;
+    return _mm512_div_ps(_mm512_set1_ps(1.0f), _mm512_sqrt_ps(d2));
+}
+
+__attribute__((target("avx512f")))
+static inline __m512 falloff_inverse4_avx512(__m512 d2, __m512 inv_r2)
+{
+    (void) inv_r2;
+    __m512 s = _mm512_div_ps(_mm512_set1_ps(1.0f), d2);
+    return _mm512_mul_ps(s, s);
+}
+
+__attribute__((target("avx512f")))
+static inline __m512 falloff_wyvill_avx512(__m512 d2, __m512 inv_r2)
+{
+    __m512 q = _mm512_mul_ps(d2, inv_r2);
+    __m512 f = _mm512_sub_ps(_mm512_set1_ps(17.0f/9.0f), _mm512_mul_ps(q, _mm512_set1_ps(4.0f/9.0f)));
+    f = _mm512_add_ps(_mm512_set1_ps(-22.0f/9.0f), _mm512_mul_ps(q, f));
+    f = _mm512_add_ps(_mm512_set1_ps(1.0f), _mm512_mul_ps(q, f));
+    return _mm512_maskz_mov_ps(_mm512_cmp_ps_mask(q, _mm512_set1_ps(1.0f), _CMP_LT_OQ), f);
+}
+
+__attribute__((target("avx512f")))
+static inline __m512 falloff_murakami_avx512(__m512 d2, __m512 inv_r2)
+{
+    __m512 t = _mm512_max_ps(_mm512_sub_ps(_mm512_set1_ps(1.0f), _mm512_mul_ps(d2, inv_r2)), _mm512_setzero_ps());
+    return _mm512_mul_ps(t, t);
+}
+
+// clamp_channel() for 16 channels, see clamp_channel_sse2()
+__attribute__((target("avx512f")))
+static inline __m512 clamp_channel_avx512(__m512 c)
+{
+    return _mm512_min_ps(_mm512_max_ps(c, _mm512_setzero_ps()), _mm512_set1_ps(255.0f));
+}
+
+__attribute__((target("avx512f")))
+static inline __m512i linear_to_srgb_avx512(__m512 t)
+{
+    t = _mm512_min_ps(_mm512_max_ps(t, _mm512_setzero_ps()), _mm512_set1_ps(SRGB_LUT_SIZE - 1));
+    __m512i index = _mm512_cvttps_epi32(t);
+    return _mm512_and_si512(_mm512_i32gather_epi32(index, (const int*) linear_to_srgb_lut, 1),
+                            _mm512_set1_epi32(0xFF));
+}
+
+__attribute__((target("avx512f")))
+static inline __m512i resolve_avx512(const Scene *scene, __m512 s, __m512 r, __m512 g, __m512 b)
+{
+    __m512 inv = _mm512_div_ps(_mm512_set1_ps(1.0f), s);
+    __m512i color;
+    switch (scene->shading) {
+    case SHADING_BLEND: {
+        __m512i ri = _mm512_cvttps_epi32(clamp_channel_avx512(_mm512_mul_ps(r, inv)));
+        __m512i gi = _mm512_cvttps_epi32(clamp_channel_avx512(_mm512_mul_ps(g, inv)));
+        __m512i bi = _mm512_cvttps_epi32(clamp_channel_avx512(_mm512_mul_ps(b, inv)));
+        color = _mm512_or_si512(_mm512_or_si512(_mm512_slli_epi32(ri, 8 * 2),
+                                                _mm512_slli_epi32(gi, 8 * 1)),
+                                bi);
+    } break;
+    case SHADING_PALETTE: {
+        __m512 t = _mm512_add_ps(_mm512_mul_ps(_mm512_mul_ps(r, inv), _mm512_set1_ps(scene->palette_scale)),
+                                 _mm512_set1_ps(0.5f));
+        t = _mm512_min_ps(_mm512_max_ps(t, _mm512_setzero_ps()), _mm512_set1_ps(PALETTE_SIZE - 1));
+        color = _mm512_i32gather_epi32(_mm512_cvttps_epi32(t), (const int*) scene->palette, sizeof(Pixel32));
+    } break;
+    case SHADING_LINEAR: {
+        inv = _mm512_mul_ps(inv, _mm512_set1_ps(SRGB_LUT_SIZE - 1));
+        color = _mm512_or_si512(_mm512_or_si512(_mm512_slli_epi32(linear_to_srgb_avx512(_mm512_mul_ps(r, inv)), 8 * 2),
+                                                _mm512_slli_epi32(linear_to_srgb_avx512(_mm512_mul_ps(g, inv)), 8 * 1)),
+                                linear_to_srgb_avx512(_mm512_mul_ps(b, inv)));
+    } break;
+    default:
+        assert(0 && "unreachable");
+        color = _mm512_setzero_si512();
+    }
+
+    __mmask16 mask = _mm512_cmp_ps_mask(s, _mm512_set1_ps(FIELD_THRESHOLD), _CMP_GE_OQ);
+    return _mm512_mask_blend_epi32(mask, _mm512_set1_epi32((int) scene->background), color);
+}
+
+__attribute__((target("avx512f")))
+static ALWAYS_INLINE void render_region_avx512_with(const Scene *scene, const Field *base,
+                                                    Pixel32 *pixels, size_t stride,
+                                                    size_t x0, size_t y0, size_t x1, size_t y1,
+                                                    __m512 (*f)(__m512 d2, __m512 inv_r2))
+{
+    const __m512 lanes = _mm512_setr_ps(0.5f, 1.5f, 2.5f, 3.5f, 4.5f, 5.5f, 6.5f, 7.5f,
+                                        8.5f, 9.5f, 10.5f, 11.5f, 12.5f, 13.5f, 14.5f, 15.5f);
+
+    for (size_t y = y0; y < y1; ++y) {
+        float py = (float) y + 0.5f;
+        size_t x = x0;
+        for (; x + 16 <= x1; x += 16) {
+            __m512 px = _mm512_add_ps(_mm512_set1_ps((float) x), lanes);
+
+            __m512 s = _mm512_setzero_ps(), r = s, g = s, b = s;
+            if (base) {
+                s = _mm512_loadu_ps(&base->s[y*stride + x]);
+                r = _mm512_loadu_ps(&base->r[y*stride + x]);
+                g = _mm512_loadu_ps(&base->g[y*stride + x]);
+                b = _mm512_loadu_ps(&base->b[y*stride + x]);
+            }
+            for (size_t i = 0; i < scene->count; ++i) {
+                float dy = scene->ys[i] - py;
+                __m512 dx = _mm512_sub_ps(_mm512_set1_ps(scene->xs[i]), px);
+                __m512 d2 = _mm512_add_ps(_mm512_mul_ps(dx, dx), _mm512_set1_ps(dy*dy));
+                __m512 si = _mm512_mul_ps(_mm512_set1_ps(scene->strengths[i]), f(d2, _mm512_set1_ps(scene->inv_radii2[i])));
+                s = _mm512_add_ps(s, si);
+                r = _mm512_add_ps(r, _mm512_mul_ps(si, _mm512_set1_ps(scene->rs[i])));
+                g = _mm512_add_ps(g, _mm512_mul_ps(si, _mm512_set1_ps(scene->gs[i])));
+                b = _mm512_add_ps(b, _mm512_mul_ps(si, _mm512_set1_ps(scene->bs[i])));
+            }
+
+            _mm512_storeu_si512((void*) &pixels[y*stride + x], resolve_avx512(scene, s, r, g, b));
+        }
+
+        if (x < x1) {
+            render_region_avx2(scene, base, pixels, stride, x, y, x1, y + 1);
+        }
+    }
+}
+
+__attribute__((target("avx512f")))
+static void render_region_avx512(const Scene *scene, const Field *base,
+                                 Pixel32 *pixels, size_t stride,
+                                 size_t x0, size_t y0, size_t x1, size_t y1)
+{
+    switch (scene->falloff) {
+    case FALLOFF_INVERSE:
+        render_region_avx512_with(scene, base, pixels, stride, x0, y0, x1, y1, falloff_inverse_avx512);
+        break;
+    case FALLOFF_INVERSE_Q2:
+        render_region_avx512_with(scene, base, pixels, stride, x0, y0, x1, y1, falloff_inverse_q2_avx512);
+        break;
+    case FALLOFF_INVERSE_SQRTF:
+        render_region_avx512_with(scene, base, pixels, stride, x0, y0, x1, y1, falloff_inverse_sqrtf_avx512);
+        break;
+    case FALLOFF_INVERSE4:
+        render_region_avx512_with(scene, base, pixels, stride, x0, y0, x1, y1, falloff_inverse4_avx512);
+        break;
+    case FALLOFF_WYVILL:
+        render_region_avx512_with(scene, base, pixels, stride, x0, y0, x1, y1, falloff_wyvill_avx512);
+        break;
+    case FALLOFF_MURAKAMI:
+        render_region_avx512_with(scene, base, pixels, stride, x0, y0, x1, y1, falloff_murakami_avx512);
+        break;
+    default:
+        assert(0 && "unreachable");
+    }
+}
+
+#endif // SIMD_X86
@@ -0,0 +1,169 @@
+// Analytic pre-pass that splits every scanline into the spans of pixels that
+// may reach FIELD_THRESHOLD and the background in between.
+//
+// If every ball i contributes less than v_i to a pixel and the v_i sum up to
+// FIELD_THRESHOLD, the pixel is background. Giving every ball the share of
+// the threshold proportional to its strength, the pixels that may be
+// foreground are within ball_influence_radius(scene, i, v_i) of at least one
+// ball, so every scanline only needs the intersections with those circles.
+// The balls of zero or negative strength only take away from the field, so
+// they get no share and no spans.
+#include <stdint.h>
+#include <stdlib.h>
+
+#define SPANS_PER_ROW_CAP 32
+// The spans are widened to multiples of the widest SIMD kernel so they don't
+// leave the kernels with narrow tails, which also keeps the SIMD kernels
+// evaluating every pixel exactly like they do without the spans
+#define SPANS_ALIGN 16
+// Rows per task of the pool
+#define SPANS_BAND 16
+
+typedef struct {
+    uint32_t x0, x1;
+} Span;
+
+typedef struct {
+    size_t width, height;
+    // SPANS_PER_ROW_CAP spans are reserved for every row
+    Span *items;
+    uint32_t *counts;
+    // Radius of every ball of the scene outside of which it can't contribute
+    // to a foreground pixel
+    float radii[SCENE_BALLS_CAP];
+    // Scratch space of spans_build_row(), the intersections of as many
+    // circles as the scene has balls for every thread of the pool
+    Span *intervals;
+    size_t intervals_cap;
+} Spans;
+
+typedef struct {
+    Spans *spans;
+    const Scene *scene;
+} Spans_Job;
+
+static int span_compare(const void *a, const void *b)
+{
+    uint32_t x0 = ((const Span *) a)->x0;
+    uint32_t x1 = ((const Span *) b)->x0;
+    return (x0 > x1) - (x0 < x1);
+}
+
+static void spans_build_row(Spans *spans, const Scene *scene, size_t y, Span *intervals)
+{
+    uint32_t width = (uint32_t) spans->width;
+
+    // Intersections of the circles with the scanline
+    size_t count = 0;
+    float py = (float) y + 0.5f;
+    for (size_t i = 0; i < scene->count; ++i) {
+        float radius = spans->radii[i];
+        float dy = scene->ys[i] - py;
+        float h2 = radius*radius - dy*dy;
+        if (h2 < 0.0f) continue;
+        float half = sqrtf(h2);
+
+        // Every pixel touching [bx - half, bx + half]
+        float lo = floorf(scene->xs[i] - half);
+        float hi = ceilf(scene->xs[i] + half);
+        if (lo < 0.0f) lo = 0.0f;
+        if (hi > (float) width) hi = (float) width;
+        if (lo >= hi) continue;
+
+        intervals[count++] = (Span) {
+            .x0 = (uint32_t) lo / SPANS_ALIGN * SPANS_ALIGN,
+            .x1 = (uint32_t) hi,
+        };
+    }
+    qsort(intervals, count, sizeof(*intervals), span_compare);
+
+    Span *row = &spans->items[y * SPANS_PER_ROW_CAP];
+    uint32_t row_count = 0;
+    for (size_t i = 0; i < count; ++i) {
+        uint32_t x1 = (intervals[i].x1 + SPANS_ALIGN - 1) / SPANS_ALIGN * SPANS_ALIGN;
+        if (x1 > width) x1 = width;
+        if (row_count > 0 && intervals[i].x0 <= row[row_count - 1].x1) {
+            if (x1 > row[row_count - 1].x1) row[row_count - 1].x1 = x1;
+        } else if (row_count < SPANS_PER_ROW_CAP) {
+            row[row_count++] = (Span) {intervals[i].x0, x1};
+        } else {
+            // Out of spans, the last one swallows the gap instead
+            row[row_count - 1].x1 = x1;
+        }
+    }
+    spans->counts[y] = row_count;
+}
+
+static void spans_build_band(void *arg, size_t index)
+{
+    const Spans_Job *job = arg;
+    Span *intervals = job->spans->intervals + pool_thread_index() * job->scene->count;
+    size_t y0 = index * SPANS_BAND;
+    size_t y1 = y0 + SPANS_BAND < job->spans->height ? y0 + SPANS_BAND : job->spans->height;
+    for (size_t y = y0; y < y1; ++y) {
+        spans_build_row(job->spans, job->scene, y, intervals);
+    }
+}
+
+void spans_build(Spans *spans, Pool *pool, size_t width, size_t height, const Scene *scene)
+{
+    if (spans->width != width || spans->height != height || spans->items == NULL) {
+        free(spans->items);
+        free(spans->counts);
+        spans->items = malloc(height * SPANS_PER_ROW_CAP * sizeof(*spans->items));
+        spans->counts = malloc(height * sizeof(*spans->counts));
+        if (spans->items == NULL || spans->counts == NULL) {
+            fprintf(stderr, "ERROR: could not allocate memory for the spans: %s\n",
+                    strerror(errno));
+            exit(1);
+        }
+        spans->width = width;
+        spans->height = height;
+    }
+
+    // Only the positive strengths, so the shares still add up to the
+    // threshold with the negative balls around
+    float total = 0.0f;
+    for (size_t i = 0; i < scene->count; ++i) {
+        if (scene->strengths[i] > 0.0f) total += scene->strengths[i];
+    }
+    for (size_t i = 0; i < scene->count; ++i) {
+        if (scene->strengths[i] <= 0.0f) {
+            spans->radii[i] = 0.0f;
+            continue;
+        }
+        float share = FIELD_THRESHOLD * scene->strengths[i] / total;
+        // An extra pixel so the rounding can't leave out a pixel right at the
+        // border of the circle
+        spans->radii[i] = ball_influence_radius(scene, i, share) + 1.0f;
+    }
+
+    size_t intervals_count = pool_threads(pool) * scene->count;
+    if (intervals_count > spans->intervals_cap) {
+        free(spans->intervals);
+        spans->intervals_cap = intervals_count * 2;
+        spans->intervals = malloc(spans->intervals_cap * sizeof(*spans->intervals));
+        if (spans->intervals == NULL) {
+            fprintf(stderr, "ERROR: could not allocate memory for the spans: %s\n",
+                    strerror(errno));
+            exit(1);
+        }
+    }
+
+    Spans_Job job = {
+        .spans = spans,
+        .scene = scene,
+    };
+    pool_run(pool, (height + SPANS_BAND - 1) / SPANS_BAND, spans_build_band, &job);
+}
+
+void spans_free(Spans *spans)
+{
+    free(spans->items);
+    free(spans->counts);
+    free(spans->intervals);
+    spans->items = NULL;
+    spans->counts = NULL;
+    spans->intervals = NULL;
+    spans->intervals_cap = 0;
+}
@@ -0,0 +1,278 @@
+// Backends writing the frames as raw video to a file, a FIFO or stdout for an
+// encoder to read. Like the headless backend the moving ball follows the
+// script of scripted_ball_pos().
+//
+// The frames are double buffered: a writer thread converts and writes one
+// frame while the next one is rendered into the other buffer, so the frame
+// loop waits only when the reader is slower than the rendering.
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+typedef enum {
+    // YUV4MPEG2 with 4:2:0 BT.601 limited range chroma, for the encoders to
+    // pick up the size and the frame rate from the header
+    STREAM_Y4M = 0,
+    // The pixels as they are in memory: blue, green, red and a zero byte
+    STREAM_BGRA,
+} Stream_Format;
+
+#define STREAM_FPS 60
+
+typedef struct {
+    FILE *file;
+    const char *path;
+    Stream_Format format;
+    size_t width, height;
+    Pixel32 *frames[2];
+    // The planes of the converted Y4M frame
+    uint8_t *yuv;
+
+    pthread_t thread;
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;
+    // Whether the frame is submitted and not written yet
+    bool busy[2];
+    // The frame submitted to the writer that it has not picked up yet, or -1
+    int queued;
+    bool done;
+} Stream;
+
+static void stream_write(Stream *stream, const void *data, size_t size)
+{
+    if (fwrite(data, size, 1, stream->file) != 1) {
+        fprintf(stderr, "ERROR: could not write to %s: %s\n", stream->path, strerror(errno));
+        exit(1);
+    }
+}
+
+static inline uint8_t rgb_to_y(int r, int g, int b)
+{
+    return (uint8_t) (((66*r + 129*g + 25*b + 128) >> 8) + 16);
+}
+
+static inline uint8_t rgb_to_u(int r, int g, int b)
+{
+    return (uint8_t) (((-38*r - 74*g + 112*b + 128) >> 8) + 128);
+}
+
+static inline uint8_t rgb_to_v(int r, int g, int b)
+{
+    return (uint8_t) (((112*r - 94*g - 18*b + 128) >> 8) + 128);
+}
+
+// Converts the frame into the Y, U and V planes of stream->yuv. The chroma of
+// every 2x2 block comes from the average of its colors.
+static void stream_convert_yuv420(Stream *stream, const Pixel32 *pixels)
+{
+    size_t width = stream->width, height = stream->height;
+    size_t cw = (width + 1) / 2, ch = (height + 1) / 2;
+    uint8_t *ys = stream->yuv;
+    uint8_t *us = ys + width * height;
+    uint8_t *vs = us + cw * ch;
+
+    for (size_t cy = 0; cy < ch; ++cy) {
+        size_t y0 = 2*cy, y1 = 2*cy + 1 < height ? 2*cy + 1 : 2*cy;
+        for (size_t cx = 0; cx < cw; ++cx) {
+            size_t x0 = 2*cx, x1 = 2*cx + 1 < width ? 2*cx + 1 : 2*cx;
+            const size_t corners[4] = {y0*width + x0, y0*width + x1, y1*width + x0, y1*width + x1};
+            int sr = 0, sg = 0, sb = 0;
+            for (size_t k = 0; k < 4; ++k) {
+                Pixel32 p = pixels[corners[k]];
+                int r = (p >> (8 * 2)) & 0xFF, g = (p >> (8 * 1)) & 0xFF, b = (p >> (8 * 0)) & 0xFF;
+                // Written twice for the pixels of the odd edges, with the
+                // same value
+                ys[corners[k]] = rgb_to_y(r, g, b);
+                sr += r;
+                sg += g;
+                sb += b;
+            }
+            us[cy*cw + cx] = rgb_to_u((sr + 2) / 4, (sg + 2) / 4, (sb + 2) / 4);
+            vs[cy*cw + cx] = rgb_to_v((sr + 2) / 4, (sg + 2) / 4, (sb + 2) / 4);
+        }
+    }
+}
+
+static void stream_write_frame(Stream *stream, const Pixel32 *pixels)
+{
+    switch (stream->format) {
+    case STREAM_Y4M: {
+        size_t cw = (stream->width + 1) / 2, ch = (stream->height + 1) / 2;
+        stream_convert_yuv420(stream, pixels);
+        static const char frame_header[] = "FRAME\n";
+        stream_write(stream, frame_header, sizeof(frame_header) - 1);
+        stream_write(stream, stream->yuv, stream->width * stream->height + 2 * cw * ch);
+    } break;
+    case STREAM_BGRA:
+        stream_write(stream, pixels, stream->width * stream->height * sizeof(Pixel32));
+        break;
+    default:
+        assert(0 && "unreachable");
+    }
+}
+
+static void *stream_writer(void *arg)
+{
+    Stream *stream = arg;
+
+    pthread_mutex_lock(&stream->mutex);
+    for (;;) {
+        while (stream->queued < 0 && !stream->done) {
+            pthread_cond_wait(&stream->cond, &stream->mutex);
+        }
+        if (stream->queued < 0) break;
+        int index = stream->queued;
+        stream->queued = -1;
+        pthread_cond_broadcast(&stream->cond);
+        pthread_mutex_unlock(&stream->mutex);
+
+        stream_write_frame(stream, stream->frames[index]);
+
+        pthread_mutex_lock(&stream->mutex);
+        stream->busy[index] = false;
+        pthread_cond_broadcast(&stream->cond);
+    }
+    pthread_mutex_unlock(&stream->mutex);
+
+    return NULL;
+}
+
+// Waits until the frame is written and can be rendered into again
+static void stream_acquire(Stream *stream, int index)
+{
+    pthread_mutex_lock(&stream->mutex);
+    while (stream->busy[index]) {
+        pthread_cond_wait(&stream->cond, &stream->mutex);
+    }
+    pthread_mutex_unlock(&stream->mutex);
+}
+
+// Waits until the writer picks up the previously submitted frame, if it has
+// not yet, and queues the frame
+static void stream_submit(Stream *stream, int index)
+{
+    pthread_mutex_lock(&stream->mutex);
+    while (stream->queued >= 0) {
+        pthread_cond_wait(&stream->cond, &stream->mutex);
+    }
+    stream->busy[index] = true;
+    stream->queued = index;
+    pthread_cond_broadcast(&stream->cond);
+    pthread_mutex_unlock(&stream->mutex);
+}
+
+static void stream_open(Stream *stream, const char *path, Stream_Format format,
+                        size_t width, size_t height)
+{
+    memset(stream, 0, sizeof(*stream));
+    stream->path = strcmp(path, "-") == 0 ? "stdout" : path;
+    stream->format = format;
+    stream->width = width;
+    stream->height = height;
+    stream->queued = -1;
+
+    // Opening a FIFO blocks until the reader shows up
+    stream->file = strcmp(path, "-") == 0 ? stdout : fopen(path, "wb");
+    if (stream->file == NULL) {
+        fprintf(stderr, "ERROR: could not open file %s: %s\n", path, strerror(errno));
+        exit(1);
+    }
+
+    for (size_t i = 0; i < 2; ++i) {
+        stream->frames[i] = malloc(width * height * sizeof(Pixel32));
+        if (stream->frames[i] == NULL) {
+            fprintf(stderr, "ERROR: could not allocate memory for pixels: %s\n",
+                    strerror(errno));
+            exit(1);
+        }
+    }
+    if (format == STREAM_Y4M) {
+        stream->yuv = malloc(width * height + 2 * ((width + 1) / 2) * ((height + 1) / 2));
+        if (stream->yuv == NULL) {
+            fprintf(stderr, "ERROR: could not allocate memory for the YUV planes: %s\n",
+                    strerror(errno));
+            exit(1);
+        }
+        fprintf(stream->file, "YUV4MPEG2 W%zu H%zu F%d:1 Ip A1:1 C420jpeg\n", width, height, STREAM_FPS);
+    }
+
+    pthread_mutex_init(&stream->mutex, NULL);
+    pthread_cond_init(&stream->cond, NULL);
+    if (pthread_create(&stream->thread, NULL, stream_writer, stream) != 0) {
+        fprintf(stderr, "ERROR: could not create the writer thread\n");
+        exit(1);
+    }
+}
+
+// Writes out the last submitted frame and closes the output
+static void stream_close(Stream *stream)
+{
+    pthread_mutex_lock(&stream->mutex);
+    stream->done = true;
+    pthread_cond_broadcast(&stream->cond);
+    pthread_mutex_unlock(&stream->mutex);
+    pthread_join(stream->thread, NULL);
+
+    if (stream->file == stdout) {
+        fflush(stdout);
+    } else {
+        fclose(stream->file);
+    }
+    pthread_mutex_destroy(&stream->mutex);
+    pthread_cond_destroy(&stream->cond);
+    free(stream->frames[0]);
+    free(stream->frames[1]);
+    free(stream->yuv);
+}
+
+static void stream_run(size_t frames, Stream_Format format)
+{
+    if (frames == 0) frames = HEADLESS_FRAMES;
+
+    Stream stream;
+    stream_open(&stream, output_path, format, WIDTH, HEIGHT);
+
+    clear_totals();
+    double begin = headless_now();
+    for (size_t frame = 0; frame < frames; ++frame) {
+        int index = frame % 2;
+        scene_move_ball(&scene, moving_ball, scripted_ball_pos(frame));
+
+        clear_summary();
+        begin_clock("TOTAL");
+        {
+            // Blocks only if the writer is still busy with the frame before
+            // the previous one
+            begin_clock("WAIT");
+            stream_acquire(&stream, index);
+            end_clock();
+
+            pixels = stream.frames[index];
+            render_frame();
+            stream_submit(&stream, index);
+        }
+        end_clock();
+        accumulate_summary();
+    }
+    stream_close(&stream);
+    double elapsed = headless_now() - begin;
+    pixels = NULL;
+
+    // stdout may be the video itself
+    fprintf(stderr, "INFO: wrote %zu frames of %dx%d to %s in %.3lf secs, %.2lf FPS\n",
+            frames, WIDTH, HEIGHT, stream.path, elapsed, frames / elapsed);
+    fprintf(stderr, "INFO: average per frame:\n");
+    dump_totals(stderr);
+}
+
+void y4m_run(size_t frames)
+{
+    stream_run(frames, STREAM_Y4M);
+}
+
+void bgra_run(size_t frames)
+{
+    stream_run(frames, STREAM_BGRA);
+}
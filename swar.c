@@ -0,0 +1,150 @@
+// Kernel accumulating the field-weighted colors in packed integers instead of
+// three separate floats. The field of every ball is still computed in floats,
+// but its weight is converted to an integer once and multiplies two 64 bit
+// words holding the color channels in 32 bit lanes (SWAR, SIMD within a
+// register): red and blue in one, green and 1 in the other, so the second lane
+// of the latter adds up the weights themselves. That is two integer
+// multiplications and additions per ball instead of three of each in floats,
+// and a single normalization per pixel.
+//
+// The lanes are signed and their sums have to stay within 32 bits, so the
+// weights are scaled per segment of a row by the upper bound of the field over
+// the segment. Segments where that scale leaves too little precision for the
+// pixels at the threshold go to render_region() instead.
+//
+// The field itself is accumulated in floats exactly like render_region() does,
+// so every pixel is background or foreground exactly like in the scalar kernel
+// and only its color may differ within rounding.
+#include <stdint.h>
+
+// Columns sharing one scale of the weights
+#define SWAR_SEGMENT 64
+// The sum of the absolute weights of a segment times 255 fits into a signed
+// 32 bit lane
+#define SWAR_WEIGHT_MAX ((float) (1 << 23))
+// Every weight loses less than 1 to the truncation. For the color to stay
+// within rounding of the exact one, the sum of the weights of a pixel at the
+// threshold has to be larger than that many times the amount of the balls.
+#define SWAR_PRECISION 1024.0f
+
+// Upper bound of the sum of the absolute fields of the balls over the pixel
+// centers of the row [x0, x1)
+static float swar_bound(const Scene *scene, size_t x0, size_t x1, size_t y)
+{
+    float left = (float) x0 + 0.5f, right = (float) x1 - 0.5f;
+    float py = (float) y + 0.5f;
+    float bound = 0.0f;
+    for (size_t i = 0; i < scene->count; ++i) {
+        float x = scene->xs[i];
+        float dx = x < left ? left - x : x > right ? x - right : 0.0f;
+        float dy = scene->ys[i] - py;
+        bound += fabsf(scene->strengths[i]) * falloff_exact(scene->falloff, dx*dx + dy*dy, scene->inv_radii2[i]);
+    }
+    return bound * (1.0f + FIELD_BOUNDS_SLACK);
+}
+
+// The lanes of the packed sum as signed integers. Even if the low lane is
+// negative and borrowed from the high one, the high one comes out right as
+// long as both fit into 32 bits.
+static inline int32_t swar_low(uint64_t packed)
+{
+    return (int32_t) (uint32_t) packed;
+}
+
+static inline int32_t swar_high(uint64_t packed)
+{
+    return (int32_t) ((packed - (uint64_t) (int64_t) swar_low(packed)) >> 32);
+}
+
+static ALWAYS_INLINE void render_region_swar_with(const Scene *scene, const Field *base,
+                                                  Pixel32 *pixels, size_t stride,
+                                                  size_t x0, size_t y0, size_t x1, size_t y1,
+                                                  Falloff_Func f)
+{
+    for (size_t y = y0; y < y1; ++y) {
+        float py = (float) y + 0.5f;
+        for (size_t sx = x0; sx < x1; sx += SWAR_SEGMENT) {
+            size_t sx1 = x1 - sx < SWAR_SEGMENT ? x1 : sx + SWAR_SEGMENT;
+
+            // Also covers the segments no ball reaches, the infinite bounds
+            // and the NaNs
+            float bound = swar_bound(scene, sx, sx1, y);
+            float scale = SWAR_WEIGHT_MAX / bound;
+            if (!(bound > 0.0f && FIELD_THRESHOLD * scale >= SWAR_PRECISION * (float) scene->count)) {
+                render_region_with(scene, base, pixels, stride, sx, y, sx1, y + 1, f);
+                continue;
+            }
+
+            for (size_t x = sx; x < sx1; ++x) {
+                float px = (float) x + 0.5f;
+
+                float s = base ? base->s[y*stride + x] : 0.0f;
+                uint64_t rb = 0, g1 = 0;
+                for (size_t i = 0; i < scene->count; ++i) {
+                    float dx = scene->xs[i] - px;
+                    float dy = scene->ys[i] - py;
+                    float si = scene->strengths[i] * f(dx*dx + dy*dy, scene->inv_radii2[i]);
+                    s += si;
+                    uint64_t w = (uint64_t) (int64_t) (si * scale);
+                    rb += w * scene->rbs[i];
+                    g1 += w * scene->g1s[i];
+                }
+
+                if (s < FIELD_THRESHOLD) {
+                    pixels[y*stride + x] = scene->background;
+                    continue;
+                }
+
+                float ws = (float) swar_low(g1);
+                float r = (float) swar_high(rb);
+                float g = (float) swar_high(g1);
+                float b = (float) swar_low(rb);
+                if (base) {
+                    // The static field cache is only available in floats
+                    ws += base->s[y*stride + x] * scale;
+                    r += base->r[y*stride + x] * scale;
+                    g += base->g[y*stride + x] * scale;
+                    b += base->b[y*stride + x] * scale;
+                }
+                float inv = 1.0f / ws;
+                r *= inv;
+                g *= inv;
+                b *= inv;
+                if (scene->negatives > 0) {
+                    r = clamp_channel(r, 255.0f);
+                    g = clamp_channel(g, 255.0f);
+                    b = clamp_channel(b, 255.0f);
+                }
+                pixels[y*stride + x] = pack_rgb(r, g, b);
+            }
+        }
+    }
+}
+
+static void render_region_swar(const Scene *scene, const Field *base,
+                               Pixel32 *pixels, size_t stride,
+                               size_t x0, size_t y0, size_t x1, size_t y1)
+{
+    switch (scene->falloff) {
+    case FALLOFF_INVERSE:
+        render_region_swar_with(scene, base, pixels, stride, x0, y0, x1, y1, falloff_inverse);
+        break;
+    case FALLOFF_INVERSE_Q2:
+        render_region_swar_with(scene, base, pixels, stride, x0, y0, x1, y1, falloff_inverse_q2);
+        break;
+    case FALLOFF_INVERSE_SQRTF:
+        render_region_swar_with(scene, base, pixels, stride, x0, y0, x1, y1, falloff_inverse_sqrtf);
+        break;
+    case FALLOFF_INVERSE4:
+        render_region_swar_with(scene, base, pixels, stride, x0, y0, x1, y1, falloff_inverse4);
+        break;
+    case FALLOFF_WYVILL:
+        render_region_swar_with(scene, base, pixels, stride, x0, y0, x1, y1, falloff_wyvill);
+        break;
+    case FALLOFF_MURAKAMI:
+        render_region_swar_with(scene, base, pixels, stride, x0, y0, x1, y1, falloff_murakami);
+        break;
+    default:
+        assert(0 && "unreachable");
+    }
+}
@@ -0,0 +1,169 @@
+// The scalar kernel specialized for scenes of 1 to UNROLLED_MAX balls. The
+// amount of balls is a compile time constant in every specialization, so the
+// loop over the balls is unrolled completely and the parameters of all of the
+// balls stay in registers for the whole region. The scenes with more balls go
+// to render_region().
+//
+// With the loop over the balls gone and no branches left in the loop over the
+// pixels, the compiler vectorizes the latter on its own. That needs
+// -fno-trapping-math (see Makefile), otherwise GCC refuses to turn the
+// comparisons of the falloffs and of the threshold into selects.
+//
+// The balls are added up in the same order and with the same operations as in
+// render_region(), so the output is exactly the same.
+
+#define UNROLLED_MAX 8
+
+#ifdef __GNUC__
+#define UNROLL _Pragma("GCC unroll 8")
+#else
+#define UNROLL
+#endif // __GNUC__
+
+// Same as resolve_pixel() but without branches, so the loops calling it can be
+// vectorized. The color channels are in [0, 256) so they convert through
+// int32_t just the same.
+static inline Pixel32 resolve_pixel_select(Pixel32 background, float s, float r, float g, float b)
+{
+    bool foreground = s >= FIELD_THRESHOLD;
+    float inv = 1.0f / (foreground ? s : 1.0f);
+    Pixel32 color = ((Pixel32) (int32_t) (r * inv) << (8 * 2))
+                  | ((Pixel32) (int32_t) (g * inv) << (8 * 1))
+                  | ((Pixel32) (int32_t) (b * inv) << (8 * 0));
+    return foreground ? color : background;
+}
+
+static ALWAYS_INLINE void render_row_unrolled_with(const Scene *scene, const Field *base,
+                                                   Pixel32 *pixels, size_t stride,
+                                                   size_t x0, size_t x1, size_t y,
+                                                   const float *xs, const float *dy2,
+                                                   const float *strengths, const float *inv_radii2,
+                                                   const float *rs, const float *gs, const float *bs,
+                                                   const size_t n, Falloff_Func f)
+{
+    // int32_t since converting it to float does not need a branch like size_t
+    for (int32_t x = (int32_t) x0; x < (int32_t) x1; ++x) {
+        float px = (float) x + 0.5f;
+
+        float s = 0.0f, r = 0.0f, g = 0.0f, b = 0.0f;
+        if (base) {
+            s = base->s[y*stride + x];
+            r = base->r[y*stride + x];
+            g = base->g[y*stride + x];
+            b = base->b[y*stride + x];
+        }
+        UNROLL
+        for (size_t i = 0; i < n; ++i) {
+            float dx = xs[i] - px;
+            float si = strengths[i] * f(dx*dx + dy2[i], inv_radii2[i]);
+            s += si;
+            r += si * rs[i];
+            g += si * gs[i];
+            b += si * bs[i];
+        }
+
+        pixels[y*stride + x] = resolve_pixel_select(scene->background, s, r, g, b);
+    }
+}
+
+static ALWAYS_INLINE void render_region_unrolled_with(const Scene *scene, const Field *base,
+                                                      Pixel32 *pixels, size_t stride,
+                                                      size_t x0, size_t y0, size_t x1, size_t y1,
+                                                      const size_t n, Falloff_Func f)
+{
+    // resolve_pixel_select() doesn't clamp the colors the negative balls pull
+    // out of range, since that would cost it its vectorization
+    if (scene->negatives > 0) {
+        render_region_with(scene, base, pixels, stride, x0, y0, x1, y1, f);
+        return;
+    }
+
+    float xs[UNROLLED_MAX], ys[UNROLLED_MAX], dy2[UNROLLED_MAX];
+    float strengths[UNROLLED_MAX], inv_radii2[UNROLLED_MAX];
+    float rs[UNROLLED_MAX], gs[UNROLLED_MAX], bs[UNROLLED_MAX];
+    UNROLL
+    for (size_t i = 0; i < n; ++i) {
+        xs[i] = scene->xs[i];
+        ys[i] = scene->ys[i];
+        strengths[i] = scene->strengths[i];
+        inv_radii2[i] = scene->inv_radii2[i];
+        rs[i] = scene->rs[i];
+        gs[i] = scene->gs[i];
+        bs[i] = scene->bs[i];
+    }
+
+    for (size_t y = y0; y < y1; ++y) {
+        float py = (float) y + 0.5f;
+        UNROLL
+        for (size_t i = 0; i < n; ++i) {
+            float dy = ys[i] - py;
+            dy2[i] = dy*dy;
+        }
+
+        // Separate copies of the row with and without base, so neither has a
+        // branch inside
+        if (base) {
+            render_row_unrolled_with(scene, base, pixels, stride, x0, x1, y, xs, dy2,
+                                     strengths, inv_radii2, rs, gs, bs, n, f);
+        } else {
+            render_row_unrolled_with(scene, NULL, pixels, stride, x0, x1, y, xs, dy2,
+                                     strengths, inv_radii2, rs, gs, bs, n, f);
+        }
+    }
+}
+
+// Defines render_region_unrolled_N() for the scenes of exactly N balls
+#define RENDER_REGION_UNROLLED(N)                                                                   \
+    static void render_region_unrolled_##N(const Scene *scene, const Field *base,                   \
+                                           Pixel32 *pixels, size_t stride,                          \
+                                           size_t x0, size_t y0, size_t x1, size_t y1)              \
+    {                                                                                               \
+        switch (scene->falloff) {                                                                   \
+        case FALLOFF_INVERSE:                                                                       \
+            render_region_unrolled_with(scene, base, pixels, stride, x0, y0, x1, y1, N, falloff_inverse); \
+            break;                                                                                  \
+        case FALLOFF_INVERSE_Q2:                                                                    \
+            render_region_unrolled_with(scene, base, pixels, stride, x0, y0, x1, y1, N, falloff_inverse_q2); \
+            break;                                                                                  \
+        case FALLOFF_INVERSE_SQRTF:                                                                 \
+            render_region_unrolled_with(scene, base, pixels, stride, x0, y0, x1, y1, N, falloff_inverse_sqrtf); \
+            break;                                                                                  \
+        case FALLOFF_INVERSE4:                                                                      \
+            render_region_unrolled_with(scene, base, pixels, stride, x0, y0, x1, y1, N, falloff_inverse4); \
+            break;                                                                                  \
+        case FALLOFF_WYVILL:                                                                        \
+            render_region_unrolled_with(scene, base, pixels, stride, x0, y0, x1, y1, N, falloff_wyvill); \
+            break;                                                                                  \
+        case FALLOFF_MURAKAMI:                                                                      \
+            render_region_unrolled_with(scene, base, pixels, stride, x0, y0, x1, y1, N, falloff_murakami); \
+            break;                                                                                  \
+        default:                                                                                    \
+            assert(0 && "unreachable");                                                             \
+        }                                                                                           \
+    }
+
+RENDER_REGION_UNROLLED(1)
+RENDER_REGION_UNROLLED(2)
+RENDER_REGION_UNROLLED(3)
+RENDER_REGION_UNROLLED(4)
+RENDER_REGION_UNROLLED(5)
+RENDER_REGION_UNROLLED(6)
+RENDER_REGION_UNROLLED(7)
+RENDER_REGION_UNROLLED(8)
+
+static void render_region_unrolled(const Scene *scene, const Field *base,
+                                   Pixel32 *pixels, size_t stride,
+                                   size_t x0, size_t y0, size_t x1, size_t y1)
+{
+    switch (scene->count) {
+    case 1: render_region_unrolled_1(scene, base, pixels, stride, x0, y0, x1, y1); break;
+    case 2: render_region_unrolled_2(scene, base, pixels, stride, x0, y0, x1, y1); break;
+    case 3: render_region_unrolled_3(scene, base, pixels, stride, x0, y0, x1, y1); break;
+    case 4: render_region_unrolled_4(scene, base, pixels, stride, x0, y0, x1, y1); break;
+    case 5: render_region_unrolled_5(scene, base, pixels, stride, x0, y0, x1, y1); break;
+    case 6: render_region_unrolled_6(scene, base, pixels, stride, x0, y0, x1, y1); break;
+    case 7: render_region_unrolled_7(scene, base, pixels, stride, x0, y0, x1, y1); break;
+    case 8: render_region_unrolled_8(scene, base, pixels, stride, x0, y0, x1, y1); break;
+    default: render_region(scene, base, pixels, stride, x0, y0, x1, y1);
+    }
+}
@@ -0,0 +1,193 @@
+// Backend drawing into a window of the X server. The frame is handed to the
+// server through a MIT-SHM segment when the extension is available, and the
+// moving ball follows the mouse.
+#include <X11/Xlib.h>
+#include <X11/extensions/XShm.h>
+#include <sys/ipc.h>
+#include <sys/shm.h>
+#include <sys/mman.h>
+
+// Returns false if the key asks to quit
+static bool handle_key(int key)
+{
+    switch (key) {
+    case 'q':
+        return false;
+    case 'k':
+        renderer.kernel = kernel_next(renderer.kernel);
+        log_kernel(renderer.kernel, &scene);
+        break;
+    case 'f':
+        scene_set_falloff(&scene, (scene.falloff + 1) % COUNT_FALLOFFS);
+        log_kernel(renderer.kernel, &scene);
+        break;
+    case 's':
+        scene_set_shading(&scene, (scene.shading + 1) % COUNT_SHADINGS);
+        log_kernel(renderer.kernel, &scene);
+        break;
+    case 'a':
+        renderer.use_aa = !renderer.use_aa;
+        fprintf(stderr, "INFO: anti-aliasing %s\n", renderer.use_aa ? "on" : "off");
+        break;
+    case 'p':
+        dump_summary(stdout);
+        print_stats();
+        break;
+    }
+    return true;
+}
+
+// Renders until the window is closed or, if frames > 0, that many frames
+void x11_run(size_t frames)
+{
+    Display *display = XOpenDisplay(NULL);
+    if (display == NULL) {
+        fprintf(stderr, "ERROR: could not open the default display\n");
+        exit(1);
+    }
+
+    Bool mit_shm_available = XShmQueryExtension(display);
+    if (!mit_shm_available) {
+        fprintf(stderr, "WARNING: could not find MIT-SHM extension\n");
+    } else {
+        fprintf(stderr, "INFO: detected MIT-SHM extension\n");
+    }
+
+    Window window = XCreateSimpleWindow(
+                        display,
+                        XDefaultRootWindow(display),
+                        0, 0,
+                        WIDTH, HEIGHT,
+                        0,
+                        0,
+                        0);
+
+    XWindowAttributes wa = {0};
+    XGetWindowAttributes(display, window, &wa);
+
+    XImage *image;
+    XShmSegmentInfo shminfo = {0};
+    if (mit_shm_available) {
+        shminfo.readOnly = True;
+        shminfo.shmid = shmget(IPC_PRIVATE, WIDTH*HEIGHT*sizeof(Pixel32), IPC_CREAT|0777);
+        if (shminfo.shmid < 0) {
+            fprintf(stderr, "ERROR: Could not create a new shared memory segment: %s\n",
+                    strerror(errno));
+            exit(1);
+        }
+
+        pixels = shmat(shminfo.shmid, 0, 0);
+        shminfo.shmaddr = (char*) pixels;
+        if (shminfo.shmaddr == (void*) -1) {
+            fprintf(stderr, "ERROR: could not memory map the shared memory segment: %s\n",
+                    strerror(errno));
+            exit(1);
+        }
+
+        if (!XShmAttach(display, &shminfo)) {
+            fprintf(stderr, "ERROR: could not attach the shared memory segment to the server\n");
+            exit(1);
+        }
+
+        image = XShmCreateImage(display,
+                                wa.visual,
+                                wa.depth,
+                                ZPixmap,
+                                (char *) pixels,
+                                &shminfo,
+                                WIDTH,
+                                HEIGHT);
+    } else {
+        pixels = mmap(NULL,
+                      WIDTH*HEIGHT*sizeof(Pixel32),
+                      PROT_READ|PROT_WRITE,
+                      MAP_PRIVATE|MAP_ANONYMOUS,
+                      -1,
+                      0);
+        if (pixels == MAP_FAILED) {
+            fprintf(stderr, "ERROR: Could not allocate memory for pixels: %s\n",
+                    strerror(errno));
+            exit(1);
+        }
+        image = XCreateImage(display,
+                             wa.visual,
+                             wa.depth,
+                             ZPixmap,
+                             0,
+                             (char*) pixels,
+                             WIDTH,
+                             HEIGHT,
+                             32,
+                             WIDTH * sizeof(Pixel32));
+    }
+
+    GC gc = XCreateGC(display, window, 0, NULL);
+
+    Atom wm_delete_window = XInternAtom(display, "WM_DELETE_WINDOW", False);
+    XSetWMProtocols(display, window, &wm_delete_window, 1);
+
+    XSelectInput(display, window, KeyPressMask | PointerMotionMask);
+
+    XMapWindow(display, window);
+
+    int CompletionType = XShmGetEventBase (display) + ShmCompletion;
+    int SafeToRender = 1;
+
+    size_t rendered = 0;
+    int quit = 0;
+    while (!quit) {
+        while (XPending(display) > 0) {
+            XEvent event = {0};
+            XNextEvent(display, &event);
+            switch (event.type) {
+            case KeyPress: {
+                if (!handle_key(XLookupKeysym(&event.xkey, 0))) quit = 1;
+            }
+            break;
+
+            case MotionNotify: {
+                scene_move_ball(&scene, moving_ball, v2f(event.xmotion.x, event.xmotion.y));
+            }
+            break;
+
+            case ClientMessage: {
+                if ((Atom) event.xclient.data.l[0] == wm_delete_window) {
+                    quit = 1;
+                }
+            }
+            break;
+
+            default: {
+                if (event.type == CompletionType) {
+                    SafeToRender = 1;
+                }
+            }
+            }
+        }
+
+        if (SafeToRender) {
+            clear_summary();
+            begin_clock("TOTAL");
+            {
+                // Returns only after every tile is rendered, so the frame is
+                // complete by the time it is handed to the X server
+                render_frame();
+
+                begin_clock("PutImage");
+                if (mit_shm_available) {
+                    XShmPutImage(display, window, gc, image, 0, 0, 0, 0, WIDTH, HEIGHT, True);
+                    SafeToRender = 0;
+                } else {
+                    XPutImage(display, window, gc, image, 0, 0, 0, 0, WIDTH, HEIGHT);
+                }
+                end_clock();
+            }
+            end_clock();
+
+            rendered += 1;
+            if (frames > 0 && rendered >= frames) quit = 1;
+        }
+    }
+
+    XCloseDisplay(display);
+}